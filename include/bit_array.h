@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * If set to @p true, performs runtime bounds-checking on bitarray length and
@@ -17,13 +18,80 @@
  */
 #define BIT_ARRAY_USE_BUILTIN_POPCOUNT false
 
+/**
+ * Size, in bytes, of the blocks whose popcounts are cached when the block
+ * cache is enabled with @p bitarray_enable_block_cache.
+ */
+#define BIT_ARRAY_BLOCK_CACHE_BYTES 4096
+
+/**
+ * Size, in bytes, of the chunks guarded by a sequence counter each when
+ * seqlock mode is enabled with @p bitarray_enable_seqlock.
+ */
+#define BIT_ARRAY_SEQLOCK_CHUNK_BYTES 4096
+
+/**
+ * If set to @p true, uses x86 SIMD intrinsics for the instruction sets the
+ * compiler targets. Otherwise, uses portable implementations.
+ */
+#define BIT_ARRAY_USE_SIMD true
+
+/**
+ * Size, in bytes, from which @p BIT_ARRAY_STORE_AUTO writes use non-temporal
+ * stores. Should be larger than the last level cache.
+ */
+#define BIT_ARRAY_STREAMING_THRESHOLD ((size_t)32 << 20)
+
+/**
+ * Size, in bytes, from which the bits of a bitarray are allocated in an
+ * anonymous memory mapping instead of on the heap, where supported.
+ * Mapped pages start zeroed without being touched, and clearing a mapped
+ * bitarray gives its whole pages back to the system instead of rewriting them.
+ */
+#define BIT_ARRAY_MMAP_THRESHOLD ((size_t)64 << 20)
+
+/**
+ * Number of indices ahead of the current one whose bytes the batched
+ * functions, such as @p bitarray_check_batch, prefetch, so that the cache
+ * misses of that many probes overlap instead of stalling one after the other.
+ */
+#define BIT_ARRAY_PREFETCH_DISTANCE 16
+
+/**
+ * Size, in bytes, from which @p bitarray_set_batch splits large batches of
+ * unsorted indices into buckets by their high bits before setting them, so
+ * that the bits of a bucket are set while their bytes stay in the cache.
+ * Should be larger than the last level cache.
+ */
+#define BIT_ARRAY_PARTITION_THRESHOLD ((size_t)64 << 20)
+
 /**
  * A compact, fixed size heap array of bit values.
  */
 typedef struct BitArray BitArray;
 
+/**
+ * How operations that rewrite a whole bitarray store their output.
+ */
+typedef enum BitArrayStoreHint {
+    /**
+     * Uses non-temporal stores from @p BIT_ARRAY_STREAMING_THRESHOLD bytes,
+     * and regular stores below.
+     */
+    BIT_ARRAY_STORE_AUTO,
+    /** Uses regular stores, which keep the written lines in the cache. */
+    BIT_ARRAY_STORE_CACHED,
+    /**
+     * Uses non-temporal stores, which bypass the cache and avoid evicting the
+     * working set, if the target supports them.
+     */
+    BIT_ARRAY_STORE_STREAMING,
+} BitArrayStoreHint;
+
 /**
  * Constructs a bitarray with all bits unset.
+ * Bitarrays of at least @p BIT_ARRAY_MMAP_THRESHOLD bytes are allocated in an
+ * anonymous memory mapping where supported, falling back to the heap.
  * @param length the length, in bits, of the bitarray. <b>Must not be zero</b>.
  * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if <tt>length > 0</tt>, and
  * if the memory allocation was successful.
@@ -39,6 +107,122 @@ BitArray* bitarray_with_capacity(size_t length);
  */
 void bitarray_delete(BitArray* ba);
 
+/**
+ * Constructs a bitarray with all bits unset in a named POSIX shared memory
+ * object, which other processes open with @p bitarray_open_shared, or
+ * inherit across @p fork, to share a single copy of its bits.
+ * Bits written by a process are seen by the others. Concurrent writes must
+ * go through the atomic operations, such as @p bitarray_atomic_set. No mode
+ * may be enabled on a shared bitarray, and it cannot be resized.
+ * @p bitarray_delete unmaps it from the calling process only, and
+ * @p bitarray_remove_shared removes its name.
+ * Only supported on Linux; may require linking with @p -lrt.
+ * @param name the name of the shared memory object, starting with a slash.
+ * It must not exist yet.
+ * @param length the length, in bits, of the bitarray. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if <tt>length > 0</tt>.
+ * @return a pointer to the constructed bitarray.
+ * If the name exists, or an error occurs creating or mapping the object,
+ * @p NULL is returned.
+ */
+BitArray* bitarray_create_shared(char const* name, size_t length);
+
+/**
+ * Maps a bitarray created by @p bitarray_create_shared in another process,
+ * sharing its bits. The creating call must have returned.
+ * @param name the name the bitarray was created with.
+ * @return a pointer to the bitarray, to be unmapped with @p bitarray_delete.
+ * If the name does not exist, does not hold a bitarray, or an error occurs
+ * mapping it, @p NULL is returned.
+ */
+BitArray* bitarray_open_shared(char const* name);
+
+/**
+ * Removes the name of a bitarray created by @p bitarray_create_shared. Its
+ * memory is released once every process has unmapped it.
+ * @param name the name the bitarray was created with.
+ * @return true if the name was removed, false otherwise.
+ */
+bool bitarray_remove_shared(char const* name);
+
+/**
+ * How the pages of a bitarray are placed across the NUMA nodes of the host.
+ */
+typedef enum BitArrayNumaPolicy {
+    /**
+     * Spreads the pages over every node, one after the other, so that scans
+     * from any node see the bandwidth of all of them.
+     */
+    BIT_ARRAY_NUMA_INTERLEAVED,
+    /**
+     * Splits the pages into one chunk per node, in order, each bound to its
+     * node, so that workers pinned to a node with @p bitarray_bind_to_chunk
+     * find their chunk in local memory.
+     */
+    BIT_ARRAY_NUMA_PARTITIONED,
+    /**
+     * Splits the pages into chunks as @p BIT_ARRAY_NUMA_PARTITIONED does, but
+     * places them by zeroing every chunk from threads pinned to its node,
+     * which the system then allocates its pages on.
+     */
+    BIT_ARRAY_NUMA_FIRST_TOUCH,
+} BitArrayNumaPolicy;
+
+/**
+ * Constructs a bitarray with all bits unset, in an anonymous memory mapping
+ * whose pages are placed across the NUMA nodes by @p policy.
+ * The parallel functions then run each thread on the home node of the chunk
+ * it works on. Placement is best effort: on hosts with a single node, off
+ * Linux, or if the system refuses it, the bitarray is constructed as by
+ * @p bitarray_with_capacity, as a single chunk.
+ * Resizing the bitarray turns it into a single chunk.
+ * @param length the length, in bits, of the bitarray. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if <tt>length > 0</tt>,
+ * and if the memory allocation was successful.
+ * @param policy how the pages are placed.
+ * @return a pointer to the constructed bitarray.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitArray* bitarray_with_numa_policy(size_t length, BitArrayNumaPolicy policy);
+
+/**
+ * Returns the number of node-local chunks of a bitarray: the number of nodes
+ * for bitarrays partitioned by node, 1 otherwise.
+ * @param ba a pointer to the bitarray.
+ * @return the number of chunks.
+ */
+unsigned bitarray_numa_chunks(BitArray const* ba);
+
+/**
+ * Gets the bits of a node-local chunk, in the interval
+ * <tt>[ *first_bit, *last_bit )</tt>. The chunks cover the bitarray in order,
+ * and start at multiples of 64 bits. A chunk may be empty.
+ * @param ba a pointer to the bitarray.
+ * @param chunk the index of the chunk. Must belong in the interval
+ * <tt>[ 0, bitarray_numa_chunks(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p chunk is in this interval.
+ * @param first_bit where to store the index of the first bit of the chunk.
+ * @param last_bit where to store the index following the last bit.
+ */
+void bitarray_numa_chunk(
+    BitArray const* ba,
+    unsigned chunk,
+    size_t* first_bit,
+    size_t* last_bit
+);
+
+/**
+ * Pins the calling thread to the CPUs of the home node of a node-local chunk.
+ * @param ba a pointer to the bitarray.
+ * @param chunk the index of the chunk. Must belong in the interval
+ * <tt>[ 0, bitarray_numa_chunks(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p chunk is in this interval.
+ * @return true if the thread was pinned, false if the bitarray is not
+ * partitioned by node or an error occurred, in which case the thread is left
+ * as it was.
+ */
+bool bitarray_bind_to_chunk(BitArray const* ba, unsigned chunk);
+
 /**
  * Checks if the bit at the index @p bit_idx is set.
  * Does not check whether @p bit_idx is a valid index in the bitarray.
@@ -73,11 +257,30 @@ bool bitarray_none(BitArray const* ba);
 
 /**
  * Returns the number of set bits.
+ * In counted mode, runs in constant time.
  * @param ba a pointer to the bitarray.
  * @return the number of set bits.
  */
 size_t bitarray_popcount(BitArray const* ba);
 
+/**
+ * Returns the number of set bits in the interval
+ * <tt>[ first_bit, last_bit )</tt>.
+ * When the block cache is enabled, only recounts the dirty blocks the interval
+ * covers.
+ * @param ba a pointer to the bitarray.
+ * @param first_bit the index of the first bit to count.
+ * @param last_bit the index following the last bit to count. Must satisfy
+ * <tt>first_bit <= last_bit <= bitarray_length(ba)</tt>. If
+ * @p BIT_ARRAY_ASSERTS is set to @p true, checks these conditions.
+ * @return the number of set bits in the interval.
+ */
+size_t bitarray_popcount_range(
+    BitArray const* ba,
+    size_t first_bit,
+    size_t last_bit
+);
+
 /**
  * Returns the ammount of bits in the bitarray.
  * @param ba a pointer to the bitarray.
@@ -118,12 +321,33 @@ void bitarray_unset(BitArray* ba, size_t bit_idx);
  */
 void bitarray_fill(BitArray* ba);
 
+/**
+ * Sets every bit in the interval <tt>[ 0, bitarray_length(ba) )</tt>, storing
+ * the bytes as told by @p hint.
+ * @param ba a pointer to the bitarray.
+ * @param hint how to store the bytes of the bitarray.
+ */
+void bitarray_fill_with(BitArray* ba, BitArrayStoreHint hint);
+
 /**
  * Unsets every bit in the interval <tt>[ 0, bitarray_length(ba) )</tt>.
+ * In scratch mode, only rewrites the words written since the last clear.
+ * Bitarrays allocated in a memory mapping discard their whole pages, which
+ * releases their memory until they are written again, unless their pages are
+ * placed across NUMA nodes.
  * @param ba a pointer to the bitarray.
  */
 void bitarray_clear(BitArray* ba);
 
+/**
+ * Unsets every bit in the interval <tt>[ 0, bitarray_length(ba) )</tt>,
+ * storing the bytes as told by @p hint.
+ * Mapped bitarrays only discard their pages with @p BIT_ARRAY_STORE_AUTO.
+ * @param ba a pointer to the bitarray.
+ * @param hint how to store the bytes of the bitarray.
+ */
+void bitarray_clear_with(BitArray* ba, BitArrayStoreHint hint);
+
 /**
  * Flips the bit at the index @p bit_idx.
  * If the bit is set, it's unset. If the bit is unset, it's set.
@@ -135,4 +359,315 @@ void bitarray_clear(BitArray* ba);
  */
 void bitarray_flip(BitArray* ba, size_t bit_idx);
 
+/**
+ * Checks if the bit at the index @p bit_idx is set, with an atomic load that
+ * sees the atomic writes of other threads and processes.
+ * @param ba a pointer to the bitarray.
+ * @param bit_idx the index of the bit to be checked. Must belong in the
+ * interval <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set
+ * to @p true, checks if @p bit_idx is in this interval.
+ * @return true if the bit is set, false otherwise.
+ */
+bool bitarray_atomic_check(BitArray const* ba, size_t bit_idx);
+
+/**
+ * Sets the bit at the index @p bit_idx with an atomic read-modify-write of
+ * its byte, so that threads, and processes sharing the bitarray, can write
+ * bits concurrently. The atomic operations are lock-free, and the bitarray
+ * must have no mode enabled.
+ * @param ba a pointer to the bitarray.
+ * @param bit_idx the index of the bit to be set. Must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval, and if no mode is
+ * enabled.
+ * @return true if the bit was already set, false otherwise.
+ */
+bool bitarray_atomic_set(BitArray* ba, size_t bit_idx);
+
+/**
+ * Unsets the bit at the index @p bit_idx with an atomic read-modify-write of
+ * its byte, as @p bitarray_atomic_set does.
+ * @param ba a pointer to the bitarray.
+ * @param bit_idx the index of the bit to be unset. Must belong in the
+ * interval <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set
+ * to @p true, checks if @p bit_idx is in this interval, and if no mode is
+ * enabled.
+ * @return true if the bit was set, false otherwise.
+ */
+bool bitarray_atomic_unset(BitArray* ba, size_t bit_idx);
+
+/**
+ * Flips the bit at the index @p bit_idx with an atomic read-modify-write of
+ * its byte, as @p bitarray_atomic_set does.
+ * @param ba a pointer to the bitarray.
+ * @param bit_idx the index of the bit to be flipped. Must belong in the
+ * interval <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set
+ * to @p true, checks if @p bit_idx is in this interval, and if no mode is
+ * enabled.
+ * @return true if the bit was set before the flip, false otherwise.
+ */
+bool bitarray_atomic_flip(BitArray* ba, size_t bit_idx);
+
+/**
+ * Checks the bits at many indices, in any order, storing the result of the
+ * check at @p indices[i] to the bit at index @p i of @p out, as if calling
+ * @p bitarray_check for each. The byte of every index is prefetched
+ * @p BIT_ARRAY_PREFETCH_DISTANCE indices ahead, so that the cache misses of
+ * random indices into a large bitarray overlap.
+ * The bits of @p out past @p count are left untouched.
+ * @param ba a pointer to the bitarray.
+ * @param indices a pointer to the first of @p count indices, each of which
+ * must belong in the interval <tt>[ 0, bitarray_length(ba) )</tt>.
+ * @param count the number of indices.
+ * @param out a pointer to the bitarray the results are stored to. Must not be
+ * @p ba, and <tt>bitarray_length(out)</tt> must not be less than @p count.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks these conditions.
+ */
+void bitarray_check_batch(
+    BitArray const* ba,
+    size_t const* indices,
+    size_t count,
+    BitArray* out
+);
+
+/**
+ * Sets the bits at many indices, in any order, as if calling
+ * @p bitarray_set for each. The byte of every index is prefetched for writing
+ * @p BIT_ARRAY_PREFETCH_DISTANCE indices ahead, as
+ * @p bitarray_check_batch does.
+ * On bitarrays of at least @p BIT_ARRAY_PARTITION_THRESHOLD bytes with no
+ * mode enabled, large batches of unsorted indices are instead radix
+ * partitioned by their high bits into buckets spanning 4 MiB of the
+ * bitarray each, gathered a cache line at a time per bucket, and every
+ * bucket is then set on its own, touching few pages while in the cache.
+ * The buckets take as much memory as the indices, twice as much past 4 GiB,
+ * and prefetching is used instead if it cannot be allocated.
+ * @param ba a pointer to the bitarray.
+ * @param indices a pointer to the first of @p count indices, each of which
+ * must belong in the interval <tt>[ 0, bitarray_length(ba) )</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition.
+ * @param count the number of indices.
+ */
+void bitarray_set_batch(BitArray* ba, size_t const* indices, size_t count);
+
+/**
+ * Enables counted mode.
+ * In counted mode, the bitarray keeps its number of set bits up to date on
+ * every write that changes a bit, so that @p bitarray_popcount,
+ * @p bitarray_all, @p bitarray_any and @p bitarray_none run in constant time.
+ * Counts the set bits once, unless counted mode is already enabled.
+ * Does nothing on bitarrays created by @p bitarray_create_shared.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the bitarray is not
+ * shared.
+ * @param ba a pointer to the bitarray.
+ */
+void bitarray_enable_counting(BitArray* ba);
+
+/**
+ * Disables counted mode. Writes stop updating the stored popcount.
+ * @param ba a pointer to the bitarray.
+ */
+void bitarray_disable_counting(BitArray* ba);
+
+/**
+ * Checks if counted mode is enabled.
+ * @param ba a pointer to the bitarray.
+ * @return true if counted mode is enabled, false otherwise.
+ */
+bool bitarray_is_counting(BitArray const* ba);
+
+/**
+ * Enables the block cache.
+ * The block cache stores the popcount of every block of
+ * @p BIT_ARRAY_BLOCK_CACHE_BYTES bytes along with a dirty bit. Writes only
+ * mark their block dirty, and @p bitarray_popcount and
+ * @p bitarray_popcount_range recount the dirty blocks and reuse the cached
+ * popcount of the others. Since counting refreshes the cache, concurrent
+ * counts on the same bitarray are not allowed.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the bitarray is not
+ * shared, and if the memory allocation was successful.
+ * @param ba a pointer to the bitarray.
+ * @return true if the block cache is enabled, false if the bitarray was
+ * created by @p bitarray_create_shared, or if an error occurs allocating
+ * memory.
+ */
+bool bitarray_enable_block_cache(BitArray* ba);
+
+/**
+ * Disables the block cache and deallocates its memory.
+ * @param ba a pointer to the bitarray.
+ */
+void bitarray_disable_block_cache(BitArray* ba);
+
+/**
+ * Enables scratch mode, meant for bitarrays that are cleared and reused many
+ * times while only a few of their bits are set in between.
+ * In scratch mode, writes record the 64-bit words they make non-zero, and
+ * @p bitarray_clear only unsets those, so its cost is proportional to the
+ * number of words touched rather than to the length of the bitarray. If more
+ * than a small fraction of the words is touched, or after
+ * @p bitarray_fill, the next clear rewrites the whole bitarray instead.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the bitarray is not
+ * shared, and if the memory allocation was successful.
+ * @param ba a pointer to the bitarray.
+ * @return true if scratch mode is enabled, false if the bitarray was
+ * created by @p bitarray_create_shared, or if an error occurs allocating
+ * memory.
+ */
+bool bitarray_enable_scratch(BitArray* ba);
+
+/**
+ * Disables scratch mode and deallocates the list of touched words.
+ * @param ba a pointer to the bitarray.
+ */
+void bitarray_disable_scratch(BitArray* ba);
+
+/**
+ * Enables seqlock mode, meant for bitarrays counted by reader threads while a
+ * writer thread changes them.
+ * In seqlock mode, every write makes the sequence counter of the chunks of
+ * @p BIT_ARRAY_SEQLOCK_CHUNK_BYTES bytes it changes odd before storing, and
+ * even again after, without taking any lock. @p bitarray_popcount,
+ * @p bitarray_popcount_range, @p bitarray_all, @p bitarray_any and
+ * @p bitarray_none then scan a chunk at a time, and rescan a chunk whose
+ * counter was odd or moved during its scan, so that they never see a write
+ * halfway through. A result may combine chunks read before and after a
+ * write. These reads skip counted mode and the block cache, whose
+ * bookkeeping is not meant to be read concurrently. Writes must still not
+ * run concurrently with one another, and the mode must be enabled and
+ * disabled while no other thread uses the bitarray.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the bitarray is not
+ * shared, and if the memory allocation was successful.
+ * @param ba a pointer to the bitarray.
+ * @return true if seqlock mode is enabled, false if the bitarray was
+ * created by @p bitarray_create_shared, or if an error occurs allocating
+ * memory.
+ */
+bool bitarray_enable_seqlock(BitArray* ba);
+
+/**
+ * Disables seqlock mode and deallocates the sequence counters.
+ * @param ba a pointer to the bitarray.
+ */
+void bitarray_disable_seqlock(BitArray* ba);
+
+/**
+ * Returns the @p width bits starting from the index @p offset, the bit at
+ * index @p offset being the lowest bit of the result.
+ * Loads at most the two words the bits straddle.
+ * @param ba a pointer to the bitarray.
+ * @param offset the index of the first bit.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>, and the bits must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks these conditions.
+ * @return the bits.
+ */
+uint64_t bitarray_get_bits(BitArray const* ba, size_t offset, unsigned width);
+
+/**
+ * Replaces the @p width bits starting from the index @p offset by the lowest
+ * @p width bits of @p value, the lowest bit of @p value going to the index
+ * @p offset.
+ * Loads and stores at most the two words the bits straddle.
+ * @param ba a pointer to the bitarray.
+ * @param offset the index of the first bit.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>, and the bits must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks these conditions.
+ * @param value the new bits.
+ */
+void bitarray_set_bits(
+    BitArray* ba,
+    size_t offset,
+    unsigned width,
+    uint64_t value
+);
+
+/**
+ * Reads @p count fields of @p width bits, the field @p i starting from the
+ * index <tt>offset + i * stride</tt>, as with @p bitarray_get_bits.
+ * @param ba a pointer to the bitarray.
+ * @param offset the index of the first bit of the first field.
+ * @param width the number of bits of every field. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>, and every field must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks these conditions.
+ * @param stride the distance, in bits, between the first bits of two
+ * consecutive fields.
+ * @param count the number of fields.
+ * @param dst a pointer to room for @p count fields.
+ */
+void bitarray_get_bits_strided(
+    BitArray const* ba,
+    size_t offset,
+    unsigned width,
+    size_t stride,
+    size_t count,
+    uint64_t* dst
+);
+
+/**
+ * Replaces @p count fields of @p width bits, the field @p i starting from the
+ * index <tt>offset + i * stride</tt>, as with @p bitarray_set_bits.
+ * @param ba a pointer to the bitarray.
+ * @param offset the index of the first bit of the first field.
+ * @param width the number of bits of every field. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>, and every field must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks these conditions.
+ * @param stride the distance, in bits, between the first bits of two
+ * consecutive fields.
+ * @param count the number of fields.
+ * @param src a pointer to the first of @p count fields.
+ */
+void bitarray_set_bits_strided(
+    BitArray* ba,
+    size_t offset,
+    unsigned width,
+    size_t stride,
+    size_t count,
+    uint64_t const* src
+);
+
+/**
+ * Calls @p fn on the index of every set bit, in increasing order, decoding
+ * the bitarray a word at a time.
+ * @param ba a pointer to the bitarray.
+ * @param fn the function called with the index of every set bit and @p ctx.
+ * @param ctx a pointer passed to every call of @p fn.
+ */
+void bitarray_for_each_set(
+    BitArray const* ba,
+    void (*fn)(size_t bit_idx, void* ctx),
+    void* ctx
+);
+
+/**
+ * Calls @p fn on the index of every set bit, from several threads at once,
+ * in no particular order.
+ * The set bits are first counted per block of 4096 bytes, in parallel. The
+ * blocks are then grouped into about eight chunks per thread holding as many
+ * set bits each, which the threads claim one after the other until none is
+ * left, so that threads done with sparse chunks take over the rest. A chunk
+ * is decoded a word at a time, skipping its blocks without a set bit.
+ * On bitarrays partitioned by node, no chunk straddles two nodes, and every
+ * thread runs on a node, claiming its chunks before helping with the others.
+ * The bits must not change during the calls.
+ * @param ba a pointer to the bitarray.
+ * @param fn the function called with the index of every set bit and @p ctx.
+ * Must be safe to call concurrently.
+ * @param ctx a pointer passed to every call of @p fn.
+ * @param threads the number of threads to run @p fn on, the calling thread
+ * included. With one thread, or if an error occurs allocating memory, the
+ * calls are made on the calling thread, in order.
+ */
+void bitarray_parallel_for_each_set(
+    BitArray const* ba,
+    void (*fn)(size_t bit_idx, void* ctx),
+    void* ctx,
+    unsigned threads
+);
+
 #endif  // BIT_ARRAY_H
@@ -0,0 +1,553 @@
+#ifndef BIT_ARRAY_KERNELS_H
+#define BIT_ARRAY_KERNELS_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Comparison between a left-hand side and a right-hand side element.
+ */
+typedef enum BitArrayCompare {
+    /** <tt>lhs == rhs</tt> */
+    BIT_ARRAY_EQ,
+    /** <tt>lhs != rhs</tt> */
+    BIT_ARRAY_NE,
+    /** <tt>lhs < rhs</tt> */
+    BIT_ARRAY_LT,
+    /** <tt>lhs <= rhs</tt> */
+    BIT_ARRAY_LE,
+    /** <tt>lhs > rhs</tt> */
+    BIT_ARRAY_GT,
+    /** <tt>lhs >= rhs</tt> */
+    BIT_ARRAY_GE,
+} BitArrayCompare;
+
+/**
+ * How the result of a predicate is combined with the bits of a bitarray.
+ */
+typedef enum BitArrayCombine {
+    /** The bit is replaced by the result. */
+    BIT_ARRAY_ASSIGN,
+    /** The bit stays set only if the result is true. */
+    BIT_ARRAY_AND,
+    /** The bit becomes set if the result is true. */
+    BIT_ARRAY_OR,
+} BitArrayCombine;
+
+/**
+ * Constructs a bitarray from an array of booleans.
+ * The bit at index @p i is set if <tt>bools[i]</tt> is @p true.
+ * @param bools a pointer to the first of @p length booleans.
+ * @param length the length, in bits, of the bitarray. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if <tt>length > 0</tt>, and
+ * if the memory allocation was successful.
+ * @return a pointer to the constructed bitarray.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitArray* bitarray_from_bools(bool const* bools, size_t length);
+
+/**
+ * Constructs a bitarray from an array of bytes.
+ * The bit at index @p i is set if <tt>bytes[i]</tt> is not zero.
+ * @param bytes a pointer to the first of @p length bytes.
+ * @param length the length, in bits, of the bitarray. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if <tt>length > 0</tt>, and
+ * if the memory allocation was successful.
+ * @return a pointer to the constructed bitarray.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitArray* bitarray_from_bytes_nonzero(uint8_t const* bytes, size_t length);
+
+/**
+ * Stores every bit of the bitarray as a boolean.
+ * <tt>bools[i]</tt> is set to @p true if the bit at index @p i is set, and to
+ * @p false otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param bools a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * booleans.
+ */
+void bitarray_to_bools(BitArray const* ba, bool* bools);
+
+/**
+ * Stores every bit of the bitarray as a byte.
+ * <tt>bytes[i]</tt> is set to @p 0xFF if the bit at index @p i is set, and to
+ * @p 0x00 otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param bytes a pointer to the first of <tt>bitarray_length(ba)</tt> bytes.
+ */
+void bitarray_to_bytes(BitArray const* ba, uint8_t* bytes);
+
+/**
+ * Compares every element of a column of 32-bit integers with @p value, and
+ * combines the result for the element at index @p i with the bit at index @p i.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * left-hand sides.
+ * @param compare the comparison to perform.
+ * @param value the right-hand side of every comparison.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_i32(
+    BitArray* ba,
+    int32_t const* column,
+    BitArrayCompare compare,
+    int32_t value,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares the elements at the same index of two columns of 32-bit integers,
+ * and combines the result for the elements at index @p i with the bit at index
+ * @p i.
+ * @param ba a pointer to the bitarray.
+ * @param lhs a pointer to the first of <tt>bitarray_length(ba)</tt> left-hand
+ * sides.
+ * @param compare the comparison to perform.
+ * @param rhs a pointer to the first of <tt>bitarray_length(ba)</tt> right-hand
+ * sides.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_i32_columns(
+    BitArray* ba,
+    int32_t const* lhs,
+    BitArrayCompare compare,
+    int32_t const* rhs,
+    BitArrayCombine combine
+);
+
+/**
+ * Checks whether every element of a column of 32-bit integers belongs to the
+ * interval <tt>[ low, high ]</tt>, and combines the result for the element at
+ * index @p i with the bit at index @p i.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * elements.
+ * @param low the lowest value of the interval.
+ * @param high the highest value of the interval.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_between_i32(
+    BitArray* ba,
+    int32_t const* column,
+    int32_t low,
+    int32_t high,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares every element of a column of 64-bit integers with @p value, and
+ * combines the result for the element at index @p i with the bit at index @p i.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * left-hand sides.
+ * @param compare the comparison to perform.
+ * @param value the right-hand side of every comparison.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_i64(
+    BitArray* ba,
+    int64_t const* column,
+    BitArrayCompare compare,
+    int64_t value,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares the elements at the same index of two columns of 64-bit integers,
+ * and combines the result for the elements at index @p i with the bit at index
+ * @p i.
+ * @param ba a pointer to the bitarray.
+ * @param lhs a pointer to the first of <tt>bitarray_length(ba)</tt> left-hand
+ * sides.
+ * @param compare the comparison to perform.
+ * @param rhs a pointer to the first of <tt>bitarray_length(ba)</tt> right-hand
+ * sides.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_i64_columns(
+    BitArray* ba,
+    int64_t const* lhs,
+    BitArrayCompare compare,
+    int64_t const* rhs,
+    BitArrayCombine combine
+);
+
+/**
+ * Checks whether every element of a column of 64-bit integers belongs to the
+ * interval <tt>[ low, high ]</tt>, and combines the result for the element at
+ * index @p i with the bit at index @p i.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * elements.
+ * @param low the lowest value of the interval.
+ * @param high the highest value of the interval.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_between_i64(
+    BitArray* ba,
+    int64_t const* column,
+    int64_t low,
+    int64_t high,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares every element of a column of floats with @p value, and combines the
+ * result for the element at index @p i with the bit at index @p i.
+ * Comparisons involving NaN are false, except for @p BIT_ARRAY_NE.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * left-hand sides.
+ * @param compare the comparison to perform.
+ * @param value the right-hand side of every comparison.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_f32(
+    BitArray* ba,
+    float const* column,
+    BitArrayCompare compare,
+    float value,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares the elements at the same index of two columns of floats, and
+ * combines the result for the elements at index @p i with the bit at index @p
+ * i.
+ * Comparisons involving NaN are false, except for @p BIT_ARRAY_NE.
+ * @param ba a pointer to the bitarray.
+ * @param lhs a pointer to the first of <tt>bitarray_length(ba)</tt> left-hand
+ * sides.
+ * @param compare the comparison to perform.
+ * @param rhs a pointer to the first of <tt>bitarray_length(ba)</tt> right-hand
+ * sides.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_f32_columns(
+    BitArray* ba,
+    float const* lhs,
+    BitArrayCompare compare,
+    float const* rhs,
+    BitArrayCombine combine
+);
+
+/**
+ * Checks whether every element of a column of floats belongs to the interval
+ * <tt>[ low, high ]</tt>, and combines the result for the element at index @p i
+ * with the bit at index @p i.
+ * Elements that are NaN don't belong to any interval.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * elements.
+ * @param low the lowest value of the interval.
+ * @param high the highest value of the interval.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_between_f32(
+    BitArray* ba,
+    float const* column,
+    float low,
+    float high,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares every element of a column of doubles with @p value, and combines the
+ * result for the element at index @p i with the bit at index @p i.
+ * Comparisons involving NaN are false, except for @p BIT_ARRAY_NE.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * left-hand sides.
+ * @param compare the comparison to perform.
+ * @param value the right-hand side of every comparison.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_f64(
+    BitArray* ba,
+    double const* column,
+    BitArrayCompare compare,
+    double value,
+    BitArrayCombine combine
+);
+
+/**
+ * Compares the elements at the same index of two columns of doubles, and
+ * combines the result for the elements at index @p i with the bit at index @p
+ * i.
+ * Comparisons involving NaN are false, except for @p BIT_ARRAY_NE.
+ * @param ba a pointer to the bitarray.
+ * @param lhs a pointer to the first of <tt>bitarray_length(ba)</tt> left-hand
+ * sides.
+ * @param compare the comparison to perform.
+ * @param rhs a pointer to the first of <tt>bitarray_length(ba)</tt> right-hand
+ * sides.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_compare_f64_columns(
+    BitArray* ba,
+    double const* lhs,
+    BitArrayCompare compare,
+    double const* rhs,
+    BitArrayCombine combine
+);
+
+/**
+ * Checks whether every element of a column of doubles belongs to the interval
+ * <tt>[ low, high ]</tt>, and combines the result for the element at index @p i
+ * with the bit at index @p i.
+ * Elements that are NaN don't belong to any interval.
+ * @param ba a pointer to the bitarray.
+ * @param column a pointer to the first of <tt>bitarray_length(ba)</tt>
+ * elements.
+ * @param low the lowest value of the interval.
+ * @param high the highest value of the interval.
+ * @param combine how to combine the results with the bits of the bitarray.
+ */
+void bitarray_between_f64(
+    BitArray* ba,
+    double const* column,
+    double low,
+    double high,
+    BitArrayCombine combine
+);
+
+/**
+ * A column of elements compacted by @p bitarray_compact_columns.
+ */
+typedef struct BitArrayColumn {
+    /** A pointer to the first of <tt>bitarray_length(ba)</tt> elements. */
+    void const* src;
+    /**
+     * A pointer to room for as many elements as there are set bits in the
+     * bitarray.
+     */
+    void* dst;
+    /** The size, in bytes, of an element. Must be either 4 or 8. */
+    size_t element_size;
+} BitArrayColumn;
+
+/**
+ * Copies to @p dst, in order, the elements of @p src whose index is the index
+ * of a set bit.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_popcount(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements copied.
+ */
+size_t bitarray_compact_u32(
+    BitArray const* ba,
+    uint32_t const* src,
+    uint32_t* dst
+);
+
+/**
+ * Copies to @p dst, in order, the elements of @p src whose index is the index
+ * of a set bit.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_popcount(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements copied.
+ */
+size_t bitarray_compact_u64(
+    BitArray const* ba,
+    uint64_t const* src,
+    uint64_t* dst
+);
+
+/**
+ * Copies to @p dst, in order, the elements of @p src whose index is the index
+ * of a set bit.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_popcount(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements copied.
+ */
+size_t bitarray_compact_f32(
+    BitArray const* ba,
+    float const* src,
+    float* dst
+);
+
+/**
+ * Copies to @p dst, in order, the elements of @p src whose index is the index
+ * of a set bit.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_popcount(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements copied.
+ */
+size_t bitarray_compact_f64(
+    BitArray const* ba,
+    double const* src,
+    double* dst
+);
+
+/**
+ * Compacts several columns by the same bitarray, as if calling
+ * @p bitarray_compact_u32 or @p bitarray_compact_u64 for each column, while
+ * reading the bits of the bitarray only once.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the size of the
+ * elements of every column is either 4 or 8.
+ * @param ba a pointer to the bitarray.
+ * @param columns a pointer to the first of @p column_count columns.
+ * @param column_count the number of columns.
+ * @return the number of elements copied to each column.
+ */
+size_t bitarray_compact_columns(
+    BitArray const* ba,
+    BitArrayColumn const* columns,
+    size_t column_count
+);
+
+/**
+ * Expands the elements of @p src to the indices of the set bits.
+ * The element of @p dst at index @p i is set to the next unused element of
+ * @p src if the bit at index @p i is set, and to @p fallback otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_popcount(ba)</tt>
+ * elements.
+ * @param fallback the element stored at the indices of the unset bits.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements of @p src used.
+ */
+size_t bitarray_expand_u32(
+    BitArray const* ba,
+    uint32_t const* src,
+    uint32_t fallback,
+    uint32_t* dst
+);
+
+/**
+ * Chooses between the elements of two arrays by the bits of the bitarray.
+ * The element of @p dst at index @p i is set to <tt>a[i]</tt> if the bit at
+ * index @p i is set, and to <tt>b[i]</tt> otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param a a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param b a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * May be equal to @p a or @p b.
+ */
+void bitarray_blend_u32(
+    BitArray const* ba,
+    uint32_t const* a,
+    uint32_t const* b,
+    uint32_t* dst
+);
+
+/**
+ * Expands the elements of @p src to the indices of the set bits.
+ * The element of @p dst at index @p i is set to the next unused element of
+ * @p src if the bit at index @p i is set, and to @p fallback otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_popcount(ba)</tt>
+ * elements.
+ * @param fallback the element stored at the indices of the unset bits.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements of @p src used.
+ */
+size_t bitarray_expand_u64(
+    BitArray const* ba,
+    uint64_t const* src,
+    uint64_t fallback,
+    uint64_t* dst
+);
+
+/**
+ * Chooses between the elements of two arrays by the bits of the bitarray.
+ * The element of @p dst at index @p i is set to <tt>a[i]</tt> if the bit at
+ * index @p i is set, and to <tt>b[i]</tt> otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param a a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param b a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * May be equal to @p a or @p b.
+ */
+void bitarray_blend_u64(
+    BitArray const* ba,
+    uint64_t const* a,
+    uint64_t const* b,
+    uint64_t* dst
+);
+
+/**
+ * Expands the elements of @p src to the indices of the set bits.
+ * The element of @p dst at index @p i is set to the next unused element of
+ * @p src if the bit at index @p i is set, and to @p fallback otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_popcount(ba)</tt>
+ * elements.
+ * @param fallback the element stored at the indices of the unset bits.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements of @p src used.
+ */
+size_t bitarray_expand_f32(
+    BitArray const* ba,
+    float const* src,
+    float fallback,
+    float* dst
+);
+
+/**
+ * Chooses between the elements of two arrays by the bits of the bitarray.
+ * The element of @p dst at index @p i is set to <tt>a[i]</tt> if the bit at
+ * index @p i is set, and to <tt>b[i]</tt> otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param a a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param b a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * May be equal to @p a or @p b.
+ */
+void bitarray_blend_f32(
+    BitArray const* ba,
+    float const* a,
+    float const* b,
+    float* dst
+);
+
+/**
+ * Expands the elements of @p src to the indices of the set bits.
+ * The element of @p dst at index @p i is set to the next unused element of
+ * @p src if the bit at index @p i is set, and to @p fallback otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param src a pointer to the first of <tt>bitarray_popcount(ba)</tt>
+ * elements.
+ * @param fallback the element stored at the indices of the unset bits.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * Must not overlap @p src.
+ * @return the number of elements of @p src used.
+ */
+size_t bitarray_expand_f64(
+    BitArray const* ba,
+    double const* src,
+    double fallback,
+    double* dst
+);
+
+/**
+ * Chooses between the elements of two arrays by the bits of the bitarray.
+ * The element of @p dst at index @p i is set to <tt>a[i]</tt> if the bit at
+ * index @p i is set, and to <tt>b[i]</tt> otherwise.
+ * @param ba a pointer to the bitarray.
+ * @param a a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param b a pointer to the first of <tt>bitarray_length(ba)</tt> elements.
+ * @param dst a pointer to room for <tt>bitarray_length(ba)</tt> elements.
+ * May be equal to @p a or @p b.
+ */
+void bitarray_blend_f64(
+    BitArray const* ba,
+    double const* a,
+    double const* b,
+    double* dst
+);
+
+#endif  // BIT_ARRAY_KERNELS_H
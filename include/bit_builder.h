@@ -0,0 +1,99 @@
+#ifndef BIT_BUILDER_H
+#define BIT_BUILDER_H
+
+#include "bit_array.h"
+#include "rank_select.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Builds a bitarray strictly from left to right, along with its rank and
+ * select directory.
+ * Bits are gathered in a 64-bit accumulator and stored one word at a time,
+ * and every stored word is counted into the directory right away, so that
+ * finishing needs no other pass over the bits. The storage grows in chunks
+ * of at least 128 KiB, which bitarrays past @p BIT_ARRAY_MMAP_THRESHOLD
+ * bytes map as whole pages.
+ */
+typedef struct BitBuilder BitBuilder;
+
+/**
+ * Constructs a bit builder with no bit appended.
+ * @param capacity the number of bits to allocate memory for up front. The
+ * storage grows past it as needed. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if the
+ * memory allocations were successful.
+ * @return a pointer to the constructed bit builder.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitBuilder* bitbuilder_with_capacity(size_t capacity);
+
+/**
+ * Deallocates the memory used by the bit builder, including the bits
+ * appended so far.
+ * @param bb a pointer to the bit builder.
+ */
+void bitbuilder_delete(BitBuilder* bb);
+
+/**
+ * Returns the number of bits appended so far.
+ * @param bb a pointer to the bit builder.
+ * @return the number of bits appended.
+ */
+size_t bitbuilder_length(BitBuilder const* bb);
+
+/**
+ * Appends a bit.
+ * @param bb a pointer to the bit builder.
+ * @param bit the bit to append.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if growing the storage was
+ * successful.
+ * @return @p false if an error occurred growing the storage, in which case
+ * nothing was appended, @p true otherwise.
+ */
+bool bitbuilder_append(BitBuilder* bb, bool bit);
+
+/**
+ * Appends the lowest @p width bits of @p value, the lowest first. Appending
+ * whole words at word boundaries stores them as they are.
+ * @param bb a pointer to the bit builder.
+ * @param value the bits to append.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>. If @p BIT_ARRAY_ASSERTS is set to @p true, checks this
+ * condition, and if growing the storage was successful.
+ * @return @p false if an error occurred growing the storage, in which case
+ * nothing was appended, @p true otherwise.
+ */
+bool bitbuilder_append_bits(BitBuilder* bb, uint64_t value, unsigned width);
+
+/**
+ * Appends @p count copies of a bit, storing whole words of them at once.
+ * @param bb a pointer to the bit builder.
+ * @param bit the bit to append.
+ * @param count the number of copies. May be zero.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if growing the storage was
+ * successful.
+ * @return @p false if an error occurred growing the storage, in which case
+ * part of the run may have been appended, @p true otherwise.
+ */
+bool bitbuilder_append_run(BitBuilder* bb, bool bit, size_t count);
+
+/**
+ * Deallocates the memory used by the bit builder, and returns a bitarray of
+ * the bits appended, trimmed to their number, along with its rank and select
+ * directory.
+ * @param bb a pointer to the bit builder. <b>At least a bit must have been
+ * appended</b>. If @p BIT_ARRAY_ASSERTS is set to @p true, checks this
+ * condition, and if the memory allocations were successful.
+ * @param rs where to store a pointer to the directory, owned by the caller.
+ * The bitarray must outlive the directory. Set to @p NULL when @p NULL is
+ * returned.
+ * @return a pointer to the bitarray, owned by the caller.
+ * If an error occurs allocating memory, or no bit was appended, @p NULL may
+ * be returned, and the bit builder is deallocated all the same.
+ */
+BitArray* bitbuilder_finish(BitBuilder* bb, RankSelect** rs);
+
+#endif  // BIT_BUILDER_H
@@ -0,0 +1,184 @@
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Appends variable width codes to a bitarray that grows as needed.
+ * Codes are written back to back, the lowest bit of every code first.
+ * Bits are gathered in a 64-bit accumulator and stored one word at a time.
+ */
+typedef struct BitWriter BitWriter;
+
+/**
+ * Reads variable width codes from an interval of a bitarray, in the order
+ * they were written by a bit writer.
+ * Bits are loaded into a 64-bit buffer, refilled with a single load whenever
+ * it runs short.
+ */
+typedef struct BitReader BitReader;
+
+/**
+ * Constructs a bit writer with no bit written.
+ * @param capacity the number of bits to allocate memory for up front. The
+ * storage grows past it as needed. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if the
+ * memory allocation was successful.
+ * @return a pointer to the constructed bit writer.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitWriter* bitwriter_with_capacity(size_t capacity);
+
+/**
+ * Deallocates the memory used by the bit writer, including the bits written
+ * so far.
+ * @param bw a pointer to the bit writer.
+ */
+void bitwriter_delete(BitWriter* bw);
+
+/**
+ * Returns the number of bits written so far.
+ * @param bw a pointer to the bit writer.
+ * @return the number of bits written.
+ */
+size_t bitwriter_length(BitWriter const* bw);
+
+/**
+ * Appends the lowest @p width bits of @p value.
+ * @param bw a pointer to the bit writer.
+ * @param value the bits to append.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>. If @p BIT_ARRAY_ASSERTS is set to @p true, checks this
+ * condition, and if growing the storage was successful.
+ * @return @p false if an error occurred growing the storage, in which case
+ * nothing was appended, @p true otherwise.
+ */
+bool bitwriter_write(BitWriter* bw, uint64_t value, unsigned width);
+
+/**
+ * Appends @p value in unary: @p value unset bits followed by a set bit.
+ * @param bw a pointer to the bit writer.
+ * @param value the integer to append.
+ * @return @p false if an error occurred growing the storage, in which case
+ * part of the code may have been appended, @p true otherwise.
+ */
+bool bitwriter_write_unary(BitWriter* bw, uint64_t value);
+
+/**
+ * Appends @p value as an Elias gamma code: the position of its highest set
+ * bit in unary, followed by the bits below its highest set bit.
+ * @param bw a pointer to the bit writer.
+ * @param value the integer to append. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition.
+ * @return @p false if an error occurred growing the storage, in which case
+ * part of the code may have been appended, @p true otherwise.
+ */
+bool bitwriter_write_gamma(BitWriter* bw, uint64_t value);
+
+/**
+ * Deallocates the memory used by the bit writer, and returns a bitarray of
+ * the bits written, trimmed to their number.
+ * @param bw a pointer to the bit writer. <b>At least a bit must have been
+ * written</b>. If @p BIT_ARRAY_ASSERTS is set to @p true, checks this
+ * condition.
+ * @return a pointer to the bitarray, owned by the caller.
+ * If an error occurs allocating memory, or no bit was written, @p NULL may be
+ * returned, and the bit writer is deallocated all the same.
+ */
+BitArray* bitwriter_finish(BitWriter* bw);
+
+/**
+ * Constructs a bit reader over the bits in the interval
+ * <tt>[ first_bit, last_bit )</tt> of a bitarray.
+ * The bitarray must outlive the bit reader, and its bits in the interval must
+ * not change while it is read.
+ * @param ba a pointer to the bitarray.
+ * @param first_bit the index of the first bit to read.
+ * @param last_bit the index following the last bit to read. Must satisfy
+ * <tt>first_bit <= last_bit <= bitarray_length(ba)</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if
+ * the memory allocation was successful.
+ * @return a pointer to the constructed bit reader.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitReader* bitreader_with_range(
+    BitArray const* ba,
+    size_t first_bit,
+    size_t last_bit
+);
+
+/**
+ * Deallocates the memory used by the bit reader.
+ * @param br a pointer to the bit reader.
+ */
+void bitreader_delete(BitReader* br);
+
+/**
+ * Returns the index, in the bitarray, of the next bit to read.
+ * @param br a pointer to the bit reader.
+ * @return the index of the next bit.
+ */
+size_t bitreader_position(BitReader const* br);
+
+/**
+ * Returns the number of bits left to read.
+ * @param br a pointer to the bit reader.
+ * @return the number of bits left.
+ */
+size_t bitreader_remaining(BitReader const* br);
+
+/**
+ * Returns the next @p width bits without consuming them, the next bit being
+ * the lowest bit of the result. Bits past the end of the interval read as
+ * unset.
+ * @param br a pointer to the bit reader.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 56 ]</tt>. If @p BIT_ARRAY_ASSERTS is set to @p true, checks this
+ * condition.
+ * @return the bits.
+ */
+uint64_t bitreader_peek(BitReader* br, unsigned width);
+
+/**
+ * Skips the next @p width bits.
+ * @param br a pointer to the bit reader.
+ * @param width the number of bits. Must not exceed
+ * <tt>bitreader_remaining(br)</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks this condition.
+ */
+void bitreader_consume(BitReader* br, size_t width);
+
+/**
+ * Returns and consumes the next @p width bits, the next bit being the lowest
+ * bit of the result.
+ * @param br a pointer to the bit reader.
+ * @param width the number of bits. Must belong in the interval
+ * <tt>[ 1, 64 ]</tt>, and must not exceed <tt>bitreader_remaining(br)</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks these conditions.
+ * @return the bits.
+ */
+uint64_t bitreader_read(BitReader* br, unsigned width);
+
+/**
+ * Returns and consumes the next integer written in unary by
+ * @p bitwriter_write_unary.
+ * @param br a pointer to the bit reader. <b>A set bit must be left</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition.
+ * @return the integer.
+ */
+uint64_t bitreader_read_unary(BitReader* br);
+
+/**
+ * Returns and consumes the next integer written as an Elias gamma code by
+ * @p bitwriter_write_gamma.
+ * @param br a pointer to the bit reader. <b>A whole code must be left</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition.
+ * @return the integer.
+ */
+uint64_t bitreader_read_gamma(BitReader* br);
+
+#endif  // BIT_STREAM_H
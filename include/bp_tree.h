@@ -0,0 +1,117 @@
+#ifndef BP_TREE_H
+#define BP_TREE_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Returned by the navigation functions of a balanced parentheses tree when
+ * the node asked for does not exist.
+ */
+#define BP_TREE_NONE SIZE_MAX
+
+/**
+ * A navigable ordinal tree, stored as the balanced parentheses of its depth
+ * first traversal in a bitarray: a set bit opens a node and an unset bit
+ * closes it. A node is identified by the index of its opening parenthesis.
+ * Navigation searches the excess of opened over closed parentheses with a
+ * range min-max tree, holding the minimum excess of every 1024 bits. Takes
+ * about 2.4 bits per node, parentheses included.
+ */
+typedef struct BpTree BpTree;
+
+/**
+ * Constructs the navigation index of a balanced parentheses sequence.
+ * The bitarray must outlive the tree, and its bits must not change while the
+ * tree is in use.
+ * @param parens a pointer to the bitarray of the parentheses. They must be
+ * balanced. Several trees, one after the other, make a forest.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if the
+ * memory allocations were successful.
+ * @return a pointer to the constructed tree.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BpTree* bptree_with_bitarray(BitArray const* parens);
+
+/**
+ * Deallocates the memory used by the tree. The bitarray is left untouched.
+ * @param bt a pointer to the tree.
+ */
+void bptree_delete(BpTree* bt);
+
+/**
+ * Returns the number of nodes of the tree.
+ * @param bt a pointer to the tree.
+ * @return the number of nodes.
+ */
+size_t bptree_node_count(BpTree const* bt);
+
+/**
+ * Returns the index of the parenthesis closing a node.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the index of its closing parenthesis.
+ */
+size_t bptree_find_close(BpTree const* bt, size_t node);
+
+/**
+ * Returns the node a parenthesis closes.
+ * @param bt a pointer to the tree.
+ * @param close the index of a closing parenthesis.
+ * @return the node.
+ */
+size_t bptree_find_open(BpTree const* bt, size_t close);
+
+/**
+ * Returns whether a node has no child.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return @p true if the node is a leaf, @p false otherwise.
+ */
+bool bptree_is_leaf(BpTree const* bt, size_t node);
+
+/**
+ * Returns the parent of a node.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the parent, or @p BP_TREE_NONE if the node is a root.
+ */
+size_t bptree_parent(BpTree const* bt, size_t node);
+
+/**
+ * Returns the first child of a node.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the first child, or @p BP_TREE_NONE if the node is a leaf.
+ */
+size_t bptree_first_child(BpTree const* bt, size_t node);
+
+/**
+ * Returns the next sibling of a node.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the next sibling, or @p BP_TREE_NONE if the node is the last child
+ * of its parent, or the last root.
+ */
+size_t bptree_next_sibling(BpTree const* bt, size_t node);
+
+/**
+ * Returns the number of nodes in the subtree of a node, itself included.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the size of the subtree.
+ */
+size_t bptree_subtree_size(BpTree const* bt, size_t node);
+
+/**
+ * Returns the number of ancestors of a node. Roots have a depth of zero.
+ * @param bt a pointer to the tree.
+ * @param node the node.
+ * @return the depth of the node.
+ */
+size_t bptree_depth(BpTree const* bt, size_t node);
+
+#endif  // BP_TREE_H
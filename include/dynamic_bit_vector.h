@@ -0,0 +1,138 @@
+#ifndef DYNAMIC_BIT_VECTOR_H
+#define DYNAMIC_BIT_VECTOR_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A heap array of bit values that grows and shrinks by inserting and erasing
+ * bits at any index, answering rank and select queries.
+ * Stored as a B+ tree whose leaves hold up to 512 bits in a single cache
+ * line, and whose inner nodes hold the number of bits and of set bits under
+ * every child. Every operation costs a walk from the root to a leaf, in
+ * O(log n).
+ */
+typedef struct DynamicBitVector DynamicBitVector;
+
+/**
+ * Constructs a dynamic bitvector with all bits unset.
+ * @param length the number of bits. May be zero.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the memory allocations
+ * were successful.
+ * @return a pointer to the constructed dynamic bitvector.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+DynamicBitVector* dynbitvector_with_length(size_t length);
+
+/**
+ * Constructs a dynamic bitvector holding a copy of the bits of a bitarray.
+ * The leaves are filled to three quarters, leaving room for insertions.
+ * @param ba a pointer to the bitarray.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the memory allocations
+ * were successful.
+ * @return a pointer to the constructed dynamic bitvector.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+DynamicBitVector* dynbitvector_with_bitarray(BitArray const* ba);
+
+/**
+ * Deallocates the memory used by the dynamic bitvector.
+ * @param dv a pointer to the dynamic bitvector.
+ */
+void dynbitvector_delete(DynamicBitVector* dv);
+
+/**
+ * Returns the number of bits of the dynamic bitvector.
+ * @param dv a pointer to the dynamic bitvector.
+ * @return the length of the dynamic bitvector.
+ */
+size_t dynbitvector_length(DynamicBitVector const* dv);
+
+/**
+ * Returns the number of set bits of the dynamic bitvector.
+ * @param dv a pointer to the dynamic bitvector.
+ * @return the number of set bits.
+ */
+size_t dynbitvector_ones(DynamicBitVector const* dv);
+
+/**
+ * Returns the bit at the index @p bit_idx.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param bit_idx the index of the bit. Must belong in the interval
+ * <tt>[ 0, dynbitvector_length(dv) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return @p true if the bit is set, @p false otherwise.
+ */
+bool dynbitvector_access(DynamicBitVector const* dv, size_t bit_idx);
+
+/**
+ * Inserts a bit at the index @p bit_idx, moving the bits from that index one
+ * index up.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param bit_idx the index of the new bit. Must belong in the interval
+ * <tt>[ 0, dynbitvector_length(dv) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval, and if splitting a node
+ * was successful.
+ * @param bit the new bit.
+ * @return @p false if an error occurred allocating memory, in which case the
+ * bits are left untouched, @p true otherwise.
+ */
+bool dynbitvector_insert(DynamicBitVector* dv, size_t bit_idx, bool bit);
+
+/**
+ * Erases the bit at the index @p bit_idx, moving the bits past that index one
+ * index down.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param bit_idx the index of the bit. Must belong in the interval
+ * <tt>[ 0, dynbitvector_length(dv) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the erased bit.
+ */
+bool dynbitvector_erase(DynamicBitVector* dv, size_t bit_idx);
+
+/**
+ * Returns the number of set bits in the interval <tt>[ 0, bit_idx )</tt>.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param bit_idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, dynbitvector_length(dv) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the number of set bits preceding @p bit_idx.
+ */
+size_t dynbitvector_rank1(DynamicBitVector const* dv, size_t bit_idx);
+
+/**
+ * Returns the index of the set bit preceded by @p rank other set bits.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param rank the rank of the set bit. Must belong in the interval
+ * <tt>[ 0, dynbitvector_ones(dv) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p rank is in this interval.
+ * @return the index of the set bit.
+ */
+size_t dynbitvector_select1(DynamicBitVector const* dv, size_t rank);
+
+/**
+ * Returns the index of the unset bit preceded by @p rank other unset bits.
+ * @param dv a pointer to the dynamic bitvector.
+ * @param rank the rank of the unset bit. Must belong in the interval
+ * <tt>[ 0, dynbitvector_length(dv) - dynbitvector_ones(dv) )</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if @p rank is in this
+ * interval.
+ * @return the index of the unset bit.
+ */
+size_t dynbitvector_select0(DynamicBitVector const* dv, size_t rank);
+
+/**
+ * Copies the bits of the dynamic bitvector to a new bitarray, a leaf at a
+ * time.
+ * @param dv a pointer to the dynamic bitvector. <b>Must not be empty</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if the
+ * memory allocation was successful.
+ * @return a pointer to the bitarray, owned by the caller.
+ * If an error occurs allocating memory, or the dynamic bitvector is empty,
+ * @p NULL may be returned.
+ */
+BitArray* dynbitvector_to_bitarray(DynamicBitVector const* dv);
+
+#endif  // DYNAMIC_BIT_VECTOR_H
@@ -0,0 +1,86 @@
+#ifndef ELIAS_FANO_H
+#define ELIAS_FANO_H
+
+#include "bit_array.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * An immutable, Elias-Fano encoded, non-decreasing sequence of unsigned
+ * integers.
+ * Every element is split into its lowest @p width bits, stored in a packed
+ * array, and its remaining high bits, stored in unary as gaps in a bitarray
+ * indexed for select queries. Takes about <tt>2 + log2(universe / length)</tt>
+ * bits per element, plus the directory of the high bits.
+ */
+typedef struct EliasFano EliasFano;
+
+/**
+ * Constructs the Elias-Fano encoding of a non-decreasing sequence.
+ * @param values a pointer to the first element of the sequence.
+ * @param length the number of elements. <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, if the
+ * elements are non-decreasing, and if the memory allocations were successful.
+ * @return a pointer to the constructed sequence.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+EliasFano* eliasfano_with_values(uint64_t const* values, size_t length);
+
+/**
+ * Deallocates the memory used by the sequence.
+ * @param ef a pointer to the sequence.
+ */
+void eliasfano_delete(EliasFano* ef);
+
+/**
+ * Returns the number of elements in the sequence.
+ * @param ef a pointer to the sequence.
+ * @return the length of the sequence.
+ */
+size_t eliasfano_length(EliasFano const* ef);
+
+/**
+ * Returns the number of bytes used by the sequence, directory included.
+ * @param ef a pointer to the sequence.
+ * @return the size of the sequence.
+ */
+size_t eliasfano_size_in_bytes(EliasFano const* ef);
+
+/**
+ * Returns the element at the index @p idx, with a select query on the high
+ * bits.
+ * @param ef a pointer to the sequence.
+ * @param idx the index of the element. Must belong in the interval
+ * <tt>[ 0, eliasfano_length(ef) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p idx is in this interval.
+ * @return the element.
+ */
+uint64_t eliasfano_access(EliasFano const* ef, size_t idx);
+
+/**
+ * Returns the index of the first element greater than or equal to @p value,
+ * jumping to the elements sharing the high bits of @p value with a select
+ * query, then scanning only those.
+ * @param ef a pointer to the sequence.
+ * @param value the lower bound.
+ * @return the index of the first element not less than @p value, or
+ * <tt>eliasfano_length(ef)</tt> if every element is less than @p value.
+ */
+size_t eliasfano_next_geq(EliasFano const* ef, uint64_t value);
+
+/**
+ * Calls @p fn on every element, in order, decoding the high bits a word at a
+ * time.
+ * @param ef a pointer to the sequence.
+ * @param fn the function called with the index of every element, the element
+ * and @p ctx.
+ * @param ctx a pointer passed to every call of @p fn.
+ */
+void eliasfano_for_each(
+    EliasFano const* ef,
+    void (*fn)(size_t idx, uint64_t value, void* ctx),
+    void* ctx
+);
+
+#endif  // ELIAS_FANO_H
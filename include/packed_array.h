@@ -0,0 +1,116 @@
+#ifndef PACKED_ARRAY_H
+#define PACKED_ARRAY_H
+
+#include "bit_array.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A compact, fixed size heap array of unsigned integers of the same width,
+ * from 1 to 64 bits, stored back to back in a bitarray.
+ * The element at index @p i occupies the bits in the interval
+ * <tt>[ i * width, (i + 1) * width )</tt>, its lowest bit first.
+ */
+typedef struct PackedArray PackedArray;
+
+/**
+ * Constructs a packed array with all elements set to zero.
+ * @param length the number of elements. <b>Must not be zero</b>.
+ * @param width the width, in bits, of every element. Must belong in the
+ * interval <tt>[ 1, 64 ]</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks these conditions, and if
+ * the memory allocation was successful.
+ * @return a pointer to the constructed packed array.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+PackedArray* packedarray_with_capacity(size_t length, unsigned width);
+
+/**
+ * Deallocates the memory used by the packed array.
+ * Any pointer to the packed array or to its bitarray becomes invalid.
+ * @param pa a pointer to the packed array.
+ */
+void packedarray_delete(PackedArray* pa);
+
+/**
+ * Returns the number of elements in the packed array.
+ * @param pa a pointer to the packed array.
+ * @return the length of the packed array.
+ */
+size_t packedarray_length(PackedArray const* pa);
+
+/**
+ * Returns the width, in bits, of the elements of the packed array.
+ * @param pa a pointer to the packed array.
+ * @return the width of the elements.
+ */
+unsigned packedarray_width(PackedArray const* pa);
+
+/**
+ * Returns the bitarray storing the elements of the packed array.
+ * @param pa a pointer to the packed array.
+ * @return a pointer to the bitarray, owned by the packed array.
+ */
+BitArray const* packedarray_bits(PackedArray const* pa);
+
+/**
+ * Returns the element at the index @p idx.
+ * Does not check whether @p idx is a valid index in the packed array.
+ * @param pa a pointer to the packed array.
+ * @param idx the index of the element. Must belong in the interval
+ * <tt>[ 0, packedarray_length(pa) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p idx is in this interval.
+ * @return the element.
+ */
+uint64_t packedarray_get(PackedArray const* pa, size_t idx);
+
+/**
+ * Replaces the element at the index @p idx.
+ * Does not check whether @p idx is a valid index in the packed array.
+ * @param pa a pointer to the packed array.
+ * @param idx the index of the element. Must belong in the interval
+ * <tt>[ 0, packedarray_length(pa) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p idx is in this interval.
+ * @param value the new element. Only its lowest @p width bits are stored.
+ */
+void packedarray_set(PackedArray* pa, size_t idx, uint64_t value);
+
+/**
+ * Copies @p count elements, starting from the index @p first, to an array of
+ * 32-bit integers.
+ * The elements must be at most 32 bits wide.
+ * @param pa a pointer to the packed array.
+ * @param first the index of the first element to copy.
+ * @param count the number of elements to copy. Must satisfy
+ * <tt>first + count <= packedarray_length(pa)</tt>. If @p BIT_ARRAY_ASSERTS is
+ * set to @p true, checks this condition and the width of the elements.
+ * @param dst a pointer to room for @p count integers.
+ */
+void packedarray_unpack(
+    PackedArray const* pa,
+    size_t first,
+    size_t count,
+    uint32_t* dst
+);
+
+/**
+ * Replaces @p count elements, starting from the index @p first, by the
+ * integers of an array.
+ * The elements must be at most 32 bits wide. Only the lowest @p width bits of
+ * every integer are stored.
+ * @param pa a pointer to the packed array.
+ * @param first the index of the first element to replace.
+ * @param count the number of elements to replace. Must satisfy
+ * <tt>first + count <= packedarray_length(pa)</tt>. If @p BIT_ARRAY_ASSERTS is
+ * set to @p true, checks this condition and the width of the elements.
+ * @param src a pointer to the first of @p count integers.
+ */
+void packedarray_pack(
+    PackedArray* pa,
+    size_t first,
+    size_t count,
+    uint32_t const* src
+);
+
+#endif  // PACKED_ARRAY_H
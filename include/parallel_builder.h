@@ -0,0 +1,77 @@
+#ifndef PARALLEL_BUILDER_H
+#define PARALLEL_BUILDER_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Lets several threads set bits of one bitarray without sharing its cache
+ * lines while they do.
+ * Every thread sets bits in a local of its own: first a list of indices,
+ * turned into a private bitarray once it holds more than one index per 256
+ * bits. Merging then ORs every local into the target bitarray, in parallel
+ * over chunks of 32 KiB of the target, every chunk taking the bits of every
+ * local while it stays in the cache: a word at a time from the dense locals,
+ * and an index at a time from the sorted sparse ones. On targets partitioned
+ * by node, every thread merges chunks of the node it runs on.
+ */
+typedef struct ParallelBuilder ParallelBuilder;
+
+/**
+ * Constructs a parallel builder for a target bitarray, with an empty local
+ * for every thread.
+ * The target must outlive the builder, and must not be written while bits
+ * are merged into it.
+ * @param target a pointer to the bitarray the bits are merged into.
+ * @param threads the number of threads setting bits, which also merge them.
+ * <b>Must not be zero</b>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition, and if the
+ * memory allocation was successful.
+ * @return a pointer to the constructed builder.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+ParallelBuilder* parallelbuilder_with_target(
+    BitArray* target,
+    unsigned threads
+);
+
+/**
+ * Deallocates the memory used by the builder, including the bits set and not
+ * merged yet. The target is left untouched.
+ * @param pb a pointer to the builder.
+ */
+void parallelbuilder_delete(ParallelBuilder* pb);
+
+/**
+ * Returns the number of threads of the builder.
+ * @param pb a pointer to the builder.
+ * @return the number of threads.
+ */
+unsigned parallelbuilder_threads(ParallelBuilder const* pb);
+
+/**
+ * Sets the bit at the index @p bit_idx in the local of a thread.
+ * Threads may call this concurrently as long as each passes its own index.
+ * @param pb a pointer to the builder.
+ * @param thread the index of the calling thread. Must belong in the interval
+ * <tt>[ 0, parallelbuilder_threads(pb) )</tt>.
+ * @param bit_idx the index of the bit in the target. Must belong in the
+ * interval <tt>[ 0, bitarray_length(target) )</tt>. If @p BIT_ARRAY_ASSERTS
+ * is set to @p true, checks these conditions, and if growing the local was
+ * successful.
+ * @return @p false if an error occurred growing the local, in which case the
+ * bit is not set, @p true otherwise.
+ */
+bool parallelbuilder_set(ParallelBuilder* pb, unsigned thread, size_t bit_idx);
+
+/**
+ * Sets the bits set in every local in the target, then empties the locals.
+ * Runs on as many threads as the builder has, and must not be called while
+ * bits are set.
+ * @param pb a pointer to the builder.
+ */
+void parallelbuilder_merge(ParallelBuilder* pb);
+
+#endif  // PARALLEL_BUILDER_H
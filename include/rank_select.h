@@ -0,0 +1,102 @@
+#ifndef RANK_SELECT_H
+#define RANK_SELECT_H
+
+#include "bit_array.h"
+
+#include <stddef.h>
+
+/**
+ * A rank and select directory over a bitarray.
+ * Stores, for every 512 bits, the number of set bits preceding them and the
+ * numbers of set bits preceding each of their 64-bit words, side by side in
+ * two words, which makes a rank query cost a single cache miss in the
+ * directory. Samples the position of every 1024th set and unset bit to bound
+ * the search of a select query.
+ * Takes about a quarter of the bits of the bitarray.
+ */
+typedef struct RankSelect RankSelect;
+
+/**
+ * Constructs the rank and select directory of a bitarray, with a single pass
+ * over its bits.
+ * The bitarray must outlive the directory, and its bits must not change while
+ * the directory is in use.
+ * @param ba a pointer to the bitarray.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the memory allocation
+ * was successful.
+ * @return a pointer to the constructed directory.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+RankSelect* rankselect_with_bitarray(BitArray const* ba);
+
+/**
+ * Deallocates the memory used by the directory. The bitarray is left
+ * untouched.
+ * @param rs a pointer to the directory.
+ */
+void rankselect_delete(RankSelect* rs);
+
+/**
+ * Returns the bitarray the directory was constructed over.
+ * @param rs a pointer to the directory.
+ * @return a pointer to the bitarray.
+ */
+BitArray const* rankselect_bits(RankSelect const* rs);
+
+/**
+ * Returns the number of bytes used by the directory, not counting the
+ * bitarray.
+ * @param rs a pointer to the directory.
+ * @return the size of the directory.
+ */
+size_t rankselect_size_in_bytes(RankSelect const* rs);
+
+/**
+ * Returns the number of set bits in the bitarray.
+ * @param rs a pointer to the directory.
+ * @return the number of set bits.
+ */
+size_t rankselect_ones(RankSelect const* rs);
+
+/**
+ * Returns the number of set bits in the interval <tt>[ 0, bit_idx )</tt>.
+ * @param rs a pointer to the directory.
+ * @param bit_idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the number of set bits preceding @p bit_idx.
+ */
+size_t rankselect_rank1(RankSelect const* rs, size_t bit_idx);
+
+/**
+ * Returns the number of unset bits in the interval <tt>[ 0, bit_idx )</tt>.
+ * @param rs a pointer to the directory.
+ * @param bit_idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the number of unset bits preceding @p bit_idx.
+ */
+size_t rankselect_rank0(RankSelect const* rs, size_t bit_idx);
+
+/**
+ * Returns the index of the set bit preceded by @p rank other set bits.
+ * @param rs a pointer to the directory.
+ * @param rank the rank of the set bit. Must belong in the interval
+ * <tt>[ 0, rankselect_ones(rs) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p rank is in this interval.
+ * @return the index of the set bit.
+ */
+size_t rankselect_select1(RankSelect const* rs, size_t rank);
+
+/**
+ * Returns the index of the unset bit preceded by @p rank other unset bits.
+ * @param rs a pointer to the directory.
+ * @param rank the rank of the unset bit. Must belong in the interval
+ * <tt>[ 0, bitarray_length(ba) - rankselect_ones(rs) )</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if @p rank is in this
+ * interval.
+ * @return the index of the unset bit.
+ */
+size_t rankselect_select0(RankSelect const* rs, size_t rank);
+
+#endif  // RANK_SELECT_H
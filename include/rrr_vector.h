@@ -0,0 +1,121 @@
+#ifndef RRR_VECTOR_H
+#define RRR_VECTOR_H
+
+#include "bit_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * An immutable, compressed copy of a bitarray answering access, rank and
+ * select queries, after Raman, Raman and Rao.
+ * The bits are split into blocks of 15, each stored as its class, the number
+ * of its set bits, in 4 bits, and its offset, its index among the blocks of
+ * its class, in as few bits as they need. Every 64 blocks, the number of
+ * preceding set bits and the position of the offset are sampled.
+ * Takes close to the zero-order entropy of the bits, plus about 0.4 bits
+ * per bit for the classes and samples: sparse or dense bitarrays shrink the
+ * most.
+ */
+typedef struct RrrVector RrrVector;
+
+/**
+ * Constructs the compressed copy of a bitarray, with a single pass over its
+ * bits.
+ * @param ba a pointer to the bitarray.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the memory allocations
+ * were successful.
+ * @return a pointer to the constructed vector.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+RrrVector* rrrvector_with_bitarray(BitArray const* ba);
+
+/**
+ * Deallocates the memory used by the vector.
+ * @param rv a pointer to the vector.
+ */
+void rrrvector_delete(RrrVector* rv);
+
+/**
+ * Returns the number of bits of the vector.
+ * @param rv a pointer to the vector.
+ * @return the length of the vector.
+ */
+size_t rrrvector_length(RrrVector const* rv);
+
+/**
+ * Returns the number of set bits of the vector.
+ * @param rv a pointer to the vector.
+ * @return the number of set bits.
+ */
+size_t rrrvector_ones(RrrVector const* rv);
+
+/**
+ * Returns the number of bytes used by the vector.
+ * @param rv a pointer to the vector.
+ * @return the size of the vector.
+ */
+size_t rrrvector_size_in_bytes(RrrVector const* rv);
+
+/**
+ * Returns the bit at the index @p bit_idx.
+ * @param rv a pointer to the vector.
+ * @param bit_idx the index of the bit. Must belong in the interval
+ * <tt>[ 0, rrrvector_length(rv) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return @p true if the bit is set, @p false otherwise.
+ */
+bool rrrvector_access(RrrVector const* rv, size_t bit_idx);
+
+/**
+ * Returns the number of set bits in the interval <tt>[ 0, bit_idx )</tt>.
+ * @param rv a pointer to the vector.
+ * @param bit_idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, rrrvector_length(rv) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the number of set bits preceding @p bit_idx.
+ */
+size_t rrrvector_rank1(RrrVector const* rv, size_t bit_idx);
+
+/**
+ * Returns the number of unset bits in the interval <tt>[ 0, bit_idx )</tt>.
+ * @param rv a pointer to the vector.
+ * @param bit_idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, rrrvector_length(rv) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p bit_idx is in this interval.
+ * @return the number of unset bits preceding @p bit_idx.
+ */
+size_t rrrvector_rank0(RrrVector const* rv, size_t bit_idx);
+
+/**
+ * Returns the index of the set bit preceded by @p rank other set bits.
+ * @param rv a pointer to the vector.
+ * @param rank the rank of the set bit. Must belong in the interval
+ * <tt>[ 0, rrrvector_ones(rv) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p rank is in this interval.
+ * @return the index of the set bit.
+ */
+size_t rrrvector_select1(RrrVector const* rv, size_t rank);
+
+/**
+ * Returns the index of the unset bit preceded by @p rank other unset bits.
+ * @param rv a pointer to the vector.
+ * @param rank the rank of the unset bit. Must belong in the interval
+ * <tt>[ 0, rrrvector_length(rv) - rrrvector_ones(rv) )</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if @p rank is in this
+ * interval.
+ * @return the index of the unset bit.
+ */
+size_t rrrvector_select0(RrrVector const* rv, size_t rank);
+
+/**
+ * Decompresses the vector into a new bitarray.
+ * @param rv a pointer to the vector.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if the memory allocation
+ * was successful.
+ * @return a pointer to the bitarray, owned by the caller.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+BitArray* rrrvector_to_bitarray(RrrVector const* rv);
+
+#endif  // RRR_VECTOR_H
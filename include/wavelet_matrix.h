@@ -0,0 +1,135 @@
+#ifndef WAVELET_MATRIX_H
+#define WAVELET_MATRIX_H
+
+#include "bit_array.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * An immutable sequence of unsigned integers, answering rank, select and
+ * range queries over its elements in time proportional to their width.
+ * Stores one bitarray per bit of the elements, from the highest, each
+ * followed by a rank and select directory. Every level holds the bit of that
+ * level of every element, with the elements stably sorted by the bits of the
+ * previous levels, zeros first.
+ * Takes about <tt>1.25 * width</tt> bits per element.
+ */
+typedef struct WaveletMatrix WaveletMatrix;
+
+/**
+ * Constructs the wavelet matrix of a sequence.
+ * @param values a pointer to the first element of the sequence.
+ * @param length the number of elements. <b>Must not be zero</b>.
+ * @param threads the number of threads sharing the construction. Every level
+ * is split between them in chunks of whole words. Zero or one constructs on
+ * the calling thread.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks if @p length is not zero,
+ * and if the memory allocations were successful.
+ * @return a pointer to the constructed wavelet matrix.
+ * If an error occurs allocating memory, @p NULL may be returned.
+ */
+WaveletMatrix* waveletmatrix_with_values(
+    uint64_t const* values,
+    size_t length,
+    unsigned threads
+);
+
+/**
+ * Deallocates the memory used by the wavelet matrix.
+ * @param wm a pointer to the wavelet matrix.
+ */
+void waveletmatrix_delete(WaveletMatrix* wm);
+
+/**
+ * Returns the number of elements in the sequence.
+ * @param wm a pointer to the wavelet matrix.
+ * @return the length of the sequence.
+ */
+size_t waveletmatrix_length(WaveletMatrix const* wm);
+
+/**
+ * Returns the number of levels, which is the width, in bits, of the greatest
+ * element, and at least 1.
+ * @param wm a pointer to the wavelet matrix.
+ * @return the width of the elements.
+ */
+unsigned waveletmatrix_width(WaveletMatrix const* wm);
+
+/**
+ * Returns the element at the index @p idx.
+ * @param wm a pointer to the wavelet matrix.
+ * @param idx the index of the element. Must belong in the interval
+ * <tt>[ 0, waveletmatrix_length(wm) )</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p idx is in this interval.
+ * @return the element.
+ */
+uint64_t waveletmatrix_access(WaveletMatrix const* wm, size_t idx);
+
+/**
+ * Returns the number of occurrences of @p value in the interval
+ * <tt>[ 0, idx )</tt>.
+ * @param wm a pointer to the wavelet matrix.
+ * @param value the element to count.
+ * @param idx the end of the interval. Must belong in the interval
+ * <tt>[ 0, waveletmatrix_length(wm) ]</tt>. If @p BIT_ARRAY_ASSERTS is set to
+ * @p true, checks if @p idx is in this interval.
+ * @return the number of occurrences.
+ */
+size_t waveletmatrix_rank(WaveletMatrix const* wm, uint64_t value, size_t idx);
+
+/**
+ * Returns the index of the occurrence of @p value preceded by @p rank other
+ * occurrences.
+ * @param wm a pointer to the wavelet matrix.
+ * @param value the element to find.
+ * @param rank the rank of the occurrence.
+ * @return the index of the occurrence, or <tt>waveletmatrix_length(wm)</tt>
+ * if @p value occurs at most @p rank times.
+ */
+size_t waveletmatrix_select(
+    WaveletMatrix const* wm,
+    uint64_t value,
+    size_t rank
+);
+
+/**
+ * Returns the element preceded by @p rank other elements when the elements
+ * in the interval <tt>[ first, last )</tt> are sorted. A @p rank of zero gives
+ * the minimum of the interval.
+ * @param wm a pointer to the wavelet matrix.
+ * @param first the index of the first element of the interval.
+ * @param last the index following the last element of the interval.
+ * @param rank the rank of the element. Must satisfy
+ * <tt>rank < last - first</tt> and <tt>last <= waveletmatrix_length(wm)</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks these conditions.
+ * @return the element.
+ */
+uint64_t waveletmatrix_quantile(
+    WaveletMatrix const* wm,
+    size_t first,
+    size_t last,
+    size_t rank
+);
+
+/**
+ * Returns the number of elements in the interval <tt>[ first, last )</tt>
+ * whose value belongs in the interval <tt>[ low, high )</tt>.
+ * @param wm a pointer to the wavelet matrix.
+ * @param first the index of the first element of the interval.
+ * @param last the index following the last element of the interval. Must
+ * satisfy <tt>first <= last <= waveletmatrix_length(wm)</tt>.
+ * If @p BIT_ARRAY_ASSERTS is set to @p true, checks this condition.
+ * @param low the least value counted.
+ * @param high the value following the greatest value counted.
+ * @return the number of elements.
+ */
+size_t waveletmatrix_range_freq(
+    WaveletMatrix const* wm,
+    size_t first,
+    size_t last,
+    uint64_t low,
+    uint64_t high
+);
+
+#endif  // WAVELET_MATRIX_H
@@ -1,44 +1,36 @@
+#define _DEFAULT_SOURCE
+
 #include "bit_array.h"
+#include "bit_array_internal.h"
 
 #include <assert.h>
-#include <limits.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static_assert(CHAR_BIT == 8, "Expected a byte to consist exactly of 8 bits.");
-
-struct BitArray {
-    size_t length_in_bits;
-    uint8_t data[];
-};
-
-// Returns a byte where every bit except the one at bit_idx is unset.
-// Does not check whether bit_idx is in the interval [0, 8).
-// Index starts from the right.
-// byte_set_at(2) = b00000100
-static inline uint8_t byte_set_at(size_t const bit_idx) {
-    return UINT8_C(0x01u) << bit_idx;
-}
-
-static inline size_t bitarray_capacity_in_bytes(BitArray const* const ba) {
-    return 1 + (ba->length_in_bits - 1) / 8;
-}
+// Large bitarrays are backed by anonymous memory mappings, whose pages can be
+// given back to the system when cleared.
+#if defined(__linux__)
+#   define BIT_ARRAY_HAS_MMAP true
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#else
+#   define BIT_ARRAY_HAS_MMAP false
+#endif
 
-// Returns a pointer to the byte following the last byte of the bitarray.
-static inline uint8_t const* bitarray_end(BitArray const* const ba) {
-    return ba->data + bitarray_capacity_in_bytes(ba);
-}
+#if BIT_ARRAY_USE_SIMD && defined(__SSE2__)
+#   include <immintrin.h>
+#endif
 
-// Returns a pointer to the last byte of the bitarray.
-static inline uint8_t const* bitarray_last(BitArray const* const ba) {
-    return ba->data + (ba->length_in_bits - 1) / 8;
-}
-
-// Returns a mutable pointer to the last byte of the bitarray.
-static inline uint8_t* bitarray_last_mut(BitArray* const ba) {
-    return ba->data + (ba->length_in_bits - 1) / 8;
-}
+// Atomic bit operations go through the byte of the bit, which other processes
+// may only update with them if they take no lock.
+static_assert(
+    ATOMIC_CHAR_LOCK_FREE == 2,
+    "Expected atomic bytes to be lock-free."
+);
 
 // Returns the number of set bits in a byte.
 static size_t byte_popcount(uint8_t const byte) {
@@ -69,15 +61,484 @@ static size_t byte_popcount(uint8_t const byte) {
 #   endif
 }
 
+// Returns the number of set bits in the bytes of the interval [first, last).
+static size_t bytes_popcount(
+    uint8_t const* const first,
+    uint8_t const* const last
+) {
+    size_t total_popcount = 0;
+
+    for (uint8_t const* it = first; it != last; ++it) {
+        total_popcount += byte_popcount(*it);
+    }
+
+    return total_popcount;
+}
+
+static inline size_t bitarray_block_count(BitArray const* const ba) {
+    return 1 + (bitarray_capacity_in_bytes(ba) - 1)
+        / BIT_ARRAY_BLOCK_CACHE_BYTES;
+}
+
+static inline void block_cache_mark_dirty(
+    BitArrayBlockCache* const cache,
+    size_t const block_idx
+) {
+    cache->dirty[block_idx / 64] |= UINT64_C(1) << (block_idx % 64);
+}
+
+// Returns the popcount of a block, recounting it first if it's dirty.
+static size_t bitarray_block_popcount(
+    BitArray const* const ba,
+    size_t const block_idx
+) {
+    BitArrayBlockCache* const cache = ba->block_cache;
+    uint64_t const dirty_bit = UINT64_C(1) << (block_idx % 64);
+
+    if (cache->dirty[block_idx / 64] & dirty_bit) {
+        uint8_t const* const first =
+            ba->data + block_idx * BIT_ARRAY_BLOCK_CACHE_BYTES;
+        uint8_t const* const end = bitarray_end(ba);
+        uint8_t const* const last =
+            (size_t)(end - first) < BIT_ARRAY_BLOCK_CACHE_BYTES
+            ? end
+            : first + BIT_ARRAY_BLOCK_CACHE_BYTES;
+
+        cache->popcounts[block_idx] = bytes_popcount(first, last);
+        cache->dirty[block_idx / 64] &= ~dirty_bit;
+    }
+
+    return cache->popcounts[block_idx];
+}
+
+// Returns the number of set bits in the bytes of the interval
+// [first_byte, last_byte), using the block cache for every whole block.
+static size_t bitarray_cached_popcount(
+    BitArray const* const ba,
+    size_t const first_byte,
+    size_t const last_byte
+) {
+    size_t const first_block = (first_byte + BIT_ARRAY_BLOCK_CACHE_BYTES - 1)
+        / BIT_ARRAY_BLOCK_CACHE_BYTES;
+    // The last block may be shorter than BIT_ARRAY_BLOCK_CACHE_BYTES.
+    size_t const last_block = last_byte == bitarray_capacity_in_bytes(ba)
+        ? bitarray_block_count(ba)
+        : last_byte / BIT_ARRAY_BLOCK_CACHE_BYTES;
+
+    if (first_block >= last_block) {
+        return bytes_popcount(ba->data + first_byte, ba->data + last_byte);
+    }
+
+    size_t total_popcount = bytes_popcount(
+        ba->data + first_byte,
+        ba->data + first_block * BIT_ARRAY_BLOCK_CACHE_BYTES
+    );
+
+    for (size_t block = first_block; block != last_block; ++block) {
+        total_popcount += bitarray_block_popcount(ba, block);
+    }
+
+    size_t const tail_byte = last_block * BIT_ARRAY_BLOCK_CACHE_BYTES;
+    if (tail_byte < last_byte) {
+        total_popcount += bytes_popcount(
+            ba->data + tail_byte,
+            ba->data + last_byte
+        );
+    }
+
+    return total_popcount;
+}
+
+// Returns the number of set bits in the non-empty interval
+// [first_bit, last_bit) of the bytes starting at data.
+static size_t bits_popcount(
+    uint8_t const* const data,
+    size_t const first_bit,
+    size_t const last_bit
+) {
+    size_t const first_byte = first_bit / 8;
+    size_t const last_byte = last_bit / 8;
+    uint8_t const head = data[first_byte] & ~(byte_set_at(first_bit % 8) - 1);
+    uint8_t const tail_mask = byte_set_at(last_bit % 8) - 1;
+
+    if (first_byte == last_byte) {
+        return byte_popcount(head & tail_mask);
+    }
+
+    size_t total_popcount = byte_popcount(head)
+        + bytes_popcount(data + first_byte + 1, data + last_byte);
+    if (last_bit % 8) {
+        total_popcount += byte_popcount(data[last_byte] & tail_mask);
+    }
+
+    return total_popcount;
+}
+
+// Returns whether any bit of the bytes covering the interval
+// [first_bit, last_bit) of the bytes starting at data is set, as 1 or 0.
+static size_t bits_any(
+    uint8_t const* const data,
+    size_t const first_bit,
+    size_t const last_bit
+) {
+    uint8_t const* const last = data + (last_bit + 7) / 8;
+
+    for (uint8_t const* it = data + first_bit / 8; it != last; ++it) {
+        if (*it) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Makes the sequence counters of the chunks of the bytes in the interval
+// [first_byte, last_byte) odd, before these bytes are rewritten. The
+// interval must not be empty.
+static void seqlock_write_begin(
+    BitArray* const ba,
+    size_t const first_byte,
+    size_t const last_byte
+) {
+    atomic_size_t* const sequences = ba->seqlock->sequences;
+    size_t const last_chunk = (last_byte - 1) / BIT_ARRAY_SEQLOCK_CHUNK_BYTES;
+
+    for (size_t chunk = first_byte / BIT_ARRAY_SEQLOCK_CHUNK_BYTES;
+        chunk <= last_chunk;
+        ++chunk
+    ) {
+        size_t const sequence =
+            atomic_load_explicit(sequences + chunk, memory_order_relaxed);
+        atomic_store_explicit(
+            sequences + chunk,
+            sequence + 1,
+            memory_order_relaxed
+        );
+    }
+
+    // The odd counters are visible before any of the new bytes.
+    atomic_thread_fence(memory_order_release);
+}
+
+// Makes the sequence counters made odd by seqlock_write_begin even again,
+// once the bytes are rewritten.
+static void seqlock_write_end(
+    BitArray* const ba,
+    size_t const first_byte,
+    size_t const last_byte
+) {
+    atomic_size_t* const sequences = ba->seqlock->sequences;
+    size_t const last_chunk = (last_byte - 1) / BIT_ARRAY_SEQLOCK_CHUNK_BYTES;
+
+    for (size_t chunk = first_byte / BIT_ARRAY_SEQLOCK_CHUNK_BYTES;
+        chunk <= last_chunk;
+        ++chunk
+    ) {
+        size_t const sequence =
+            atomic_load_explicit(sequences + chunk, memory_order_relaxed);
+        atomic_store_explicit(
+            sequences + chunk,
+            sequence + 1,
+            memory_order_release
+        );
+    }
+}
+
+// Returns the sum of scan over the bits of the interval
+// [first_bit, last_bit), called on the bits of a chunk at a time. A chunk is
+// scanned again until no write to it was in progress during its scan. If
+// stop_early, returns as soon as a chunk scans to non-zero.
+static size_t seqlock_scan(
+    BitArray const* const ba,
+    size_t const first_bit,
+    size_t const last_bit,
+    size_t (*const scan)(uint8_t const*, size_t, size_t),
+    bool const stop_early
+) {
+    atomic_size_t* const sequences = ba->seqlock->sequences;
+    size_t const chunk_bits = (size_t)BIT_ARRAY_SEQLOCK_CHUNK_BYTES * 8;
+    size_t total = 0;
+
+    for (size_t first = first_bit; first < last_bit;) {
+        size_t const chunk = first / chunk_bits;
+        size_t const chunk_end = (chunk + 1) * chunk_bits;
+        size_t const last = chunk_end < last_bit ? chunk_end : last_bit;
+        size_t result;
+
+        for (;;) {
+            size_t const before =
+                atomic_load_explicit(sequences + chunk, memory_order_acquire);
+            if (before % 2) {
+                continue;
+            }
+
+            result = scan(ba->data, first, last);
+
+            // The bytes are read before the counter is read again.
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(sequences + chunk, memory_order_relaxed)
+                == before
+            ) {
+                break;
+            }
+        }
+
+        total += result;
+        if (stop_early && result) {
+            break;
+        }
+        first = last;
+    }
+
+    return total;
+}
+
+void bitarray_bytes_will_change(
+    BitArray* const ba,
+    size_t const first_byte,
+    size_t const last_byte
+) {
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        ba->popcount -= bytes_popcount(
+            ba->data + first_byte,
+            ba->data + last_byte
+        );
+    }
+
+    if ((ba->flags & BIT_ARRAY_SEQLOCKED) && first_byte != last_byte) {
+        seqlock_write_begin(ba, first_byte, last_byte);
+    }
+}
+
+void bitarray_bytes_did_change(
+    BitArray* const ba,
+    size_t const first_byte,
+    size_t const last_byte
+) {
+    if (first_byte == last_byte) {
+        return;
+    }
+
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        seqlock_write_end(ba, first_byte, last_byte);
+    }
+
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        ba->popcount += bytes_popcount(
+            ba->data + first_byte,
+            ba->data + last_byte
+        );
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        size_t const first_block = first_byte / BIT_ARRAY_BLOCK_CACHE_BYTES;
+        size_t const last_block =
+            (last_byte - 1) / BIT_ARRAY_BLOCK_CACHE_BYTES;
+
+        for (size_t block = first_block; block <= last_block; ++block) {
+            block_cache_mark_dirty(ba->block_cache, block);
+        }
+    }
+
+    if (ba->flags & BIT_ARRAY_SCRATCH) {
+        // The words made non-zero are unknown.
+        ba->scratch->overflowed = true;
+    }
+}
+
+// Replaces the byte at byte_idx by value, updating the bookkeeping of every
+// enabled mode. Only called when at least one mode is enabled.
+static void bitarray_store_byte(
+    BitArray* const ba,
+    size_t const byte_idx,
+    uint8_t const value
+) {
+    uint8_t const old = ba->data[byte_idx];
+    if (old == value) {
+        return;
+    }
+
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        ba->popcount += byte_popcount(value);
+        ba->popcount -= byte_popcount(old);
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        block_cache_mark_dirty(
+            ba->block_cache,
+            byte_idx / BIT_ARRAY_BLOCK_CACHE_BYTES
+        );
+    }
+
+    if (ba->flags & BIT_ARRAY_SCRATCH) {
+        BitArrayScratch* const scratch = ba->scratch;
+        size_t const word_idx = byte_idx / 8;
+
+        if (!scratch->overflowed && !bitarray_load_word(ba, word_idx)) {
+            if (scratch->count == scratch->capacity) {
+                scratch->overflowed = true;
+            } else {
+                scratch->touched_words[scratch->count++] = word_idx;
+            }
+        }
+    }
+
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        seqlock_write_begin(ba, byte_idx, byte_idx + 1);
+        ba->data[byte_idx] = value;
+        seqlock_write_end(ba, byte_idx, byte_idx + 1);
+        return;
+    }
+
+    ba->data[byte_idx] = value;
+}
+
+#if BIT_ARRAY_HAS_MMAP
+// Returns the number of bytes mapped for a bitarray of the given length.
+static inline size_t mapping_in_bytes(size_t const length) {
+    return sizeof(BitArray) + storage_in_bytes(length);
+}
+
+BitArray* bitarray_map(size_t const length) {
+    void* const mapping = mmap(
+        NULL,
+        mapping_in_bytes(length),
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    BitArray* const ba = mapping;
+    ba->mapped = true;
+    return ba;
+}
+
+// Unsets the bytes of the interval [first, last) of a mapped bitarray by
+// discarding the whole pages it covers, which the system then maps back as
+// zeroed pages on first touch. Only the partial pages at the edges are written.
+static void bytes_discard(uint8_t* const first, uint8_t* const last) {
+    uintptr_t const page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t const first_page =
+        ((uintptr_t)first + page_size - 1) & ~(page_size - 1);
+    uintptr_t const last_page = (uintptr_t)last & ~(page_size - 1);
+
+    if (first_page >= last_page
+        || madvise((void*)first_page, last_page - first_page, MADV_DONTNEED)
+    ) {
+        memset(first, 0x00, (size_t)(last - first));
+        return;
+    }
+
+    memset(first, 0x00, (size_t)((uint8_t*)first_page - first));
+    memset((uint8_t*)last_page, 0x00, (size_t)(last - (uint8_t*)last_page));
+}
+
+// Maps the whole shared memory object open as fd, of the given size.
+// Returns NULL if the mapping fails.
+static BitArray* bitarray_map_shared(int const fd, size_t const size) {
+    void* const mapping = mmap(
+        NULL,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        fd,
+        0
+    );
+
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+#endif
+
+// Sets the count bytes starting at first to value, using non-temporal stores
+// where available so that the written lines don't evict the cache.
+static void bytes_stream(
+    uint8_t* const first,
+    uint8_t const value,
+    size_t const count
+) {
+#   if BIT_ARRAY_USE_SIMD && defined(__SSE2__)
+    uint8_t* const last = first + count;
+    // Non-temporal stores must be aligned and should fill whole cache lines.
+    uint8_t* const first_line =
+        (uint8_t*)(((uintptr_t)first + 63) & ~(uintptr_t)63);
+    uint8_t* const last_line = (uint8_t*)((uintptr_t)last & ~(uintptr_t)63);
+
+    if (first_line >= last_line) {
+        memset(first, value, count);
+        return;
+    }
+
+    memset(first, value, (size_t)(first_line - first));
+
+#   if defined(__AVX512F__)
+    __m512i const line = _mm512_set1_epi8((char)value);
+    for (uint8_t* it = first_line; it != last_line; it += 64) {
+        _mm512_stream_si512((void*)it, line);
+    }
+#   elif defined(__AVX__)
+    __m256i const half_line = _mm256_set1_epi8((char)value);
+    for (uint8_t* it = first_line; it != last_line; it += 64) {
+        _mm256_stream_si256((__m256i*)it, half_line);
+        _mm256_stream_si256((__m256i*)(it + 32), half_line);
+    }
+#   else
+    __m128i const quarter_line = _mm_set1_epi8((char)value);
+    for (uint8_t* it = first_line; it != last_line; it += 64) {
+        _mm_stream_si128((__m128i*)it, quarter_line);
+        _mm_stream_si128((__m128i*)(it + 16), quarter_line);
+        _mm_stream_si128((__m128i*)(it + 32), quarter_line);
+        _mm_stream_si128((__m128i*)(it + 48), quarter_line);
+    }
+#   endif
+
+    // Orders the non-temporal stores before any later store.
+    _mm_sfence();
+
+    memset(last_line, value, (size_t)(last - last_line));
+#   else
+    memset(first, value, count);
+#   endif
+}
+
+// Sets the count bytes starting at first to value, honoring the store hint.
+static void bytes_set(
+    uint8_t* const first,
+    uint8_t const value,
+    size_t const count,
+    BitArrayStoreHint const hint
+) {
+    bool const streaming = hint == BIT_ARRAY_STORE_STREAMING
+        || (hint == BIT_ARRAY_STORE_AUTO
+            && count >= BIT_ARRAY_STREAMING_THRESHOLD);
+
+    if (streaming) {
+        bytes_stream(first, value, count);
+    } else {
+        memset(first, value, count);
+    }
+}
+
 BitArray* bitarray_with_capacity(size_t const length) {
 #   if BIT_ARRAY_ASSERTS
     assert(length);
 #   endif
 
-    BitArray* const ba = calloc(
-        1,
-        sizeof(BitArray) + 1 + (length - 1) / 8  // converting bits to bytes
-    );
+    BitArray* ba = NULL;
+
+#   if BIT_ARRAY_HAS_MMAP
+    if (storage_in_bytes(length) >= BIT_ARRAY_MMAP_THRESHOLD) {
+        ba = bitarray_map(length);
+    }
+#   endif
+
+    if (!ba) {
+        ba = calloc(1, sizeof(BitArray) + storage_in_bytes(length));
+    }
 
 #   if BIT_ARRAY_ASSERTS
     assert(ba);
@@ -92,9 +553,187 @@ BitArray* bitarray_with_capacity(size_t const length) {
 }
 
 void bitarray_delete(BitArray* const ba) {
+    if (!ba) {
+        return;
+    }
+
+    free(ba->block_cache);
+    free(ba->scratch);
+    free(ba->seqlock);
+
+#   if BIT_ARRAY_HAS_MMAP
+    if (ba->mapped) {
+        munmap(ba, mapping_in_bytes(ba->length_in_bits));
+        return;
+    }
+#   endif
+
     free(ba);
 }
 
+BitArray* bitarray_create_shared(char const* const name, size_t const length) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+#   endif
+
+#   if BIT_ARRAY_HAS_MMAP
+    int const fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    // The object is zero-filled as it grows, so every bit starts unset.
+    size_t const size = mapping_in_bytes(length);
+    BitArray* const ba = ftruncate(fd, (off_t)size)
+        ? NULL
+        : bitarray_map_shared(fd, size);
+    close(fd);
+
+    if (!ba) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // The header lives in the object, where openers read the length from.
+    ba->length_in_bits = length;
+    ba->mapped = true;
+    ba->shared = true;
+    return ba;
+#   else
+    (void)name;
+    (void)length;
+    return NULL;
+#   endif
+}
+
+BitArray* bitarray_open_shared(char const* const name) {
+#   if BIT_ARRAY_HAS_MMAP
+    int const fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat info;
+    BitArray* const ba = fstat(fd, &info)
+        || (size_t)info.st_size < sizeof(BitArray)
+        ? NULL
+        : bitarray_map_shared(fd, (size_t)info.st_size);
+    close(fd);
+
+    if (!ba) {
+        return NULL;
+    }
+
+    // Rejects objects not created by bitarray_create_shared.
+    if (!ba->shared
+        || ba->flags
+        || !ba->length_in_bits
+        || mapping_in_bytes(ba->length_in_bits) != (size_t)info.st_size
+    ) {
+        munmap(ba, (size_t)info.st_size);
+        return NULL;
+    }
+
+    return ba;
+#   else
+    (void)name;
+    return NULL;
+#   endif
+}
+
+bool bitarray_remove_shared(char const* const name) {
+#   if BIT_ARRAY_HAS_MMAP
+    return !shm_unlink(name);
+#   else
+    (void)name;
+    return false;
+#   endif
+}
+
+BitArray* bitarray_resize(BitArray* const ba, size_t const length) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+    assert(!ba->flags);
+    assert(!ba->shared);
+#   else
+    // Other processes map the shared memory object with its length.
+    if (ba->shared) {
+        return NULL;
+    }
+#   endif
+
+    size_t const old_bytes = storage_in_bytes(ba->length_in_bits);
+    size_t const new_bytes = storage_in_bytes(length);
+
+    // Unsets the bits of the last word kept past the new length.
+    if (length < ba->length_in_bits && length % 64) {
+        uint8_t* const word = ba->data + new_bytes - 8;
+        store_word(word, load_word(word) & low_bits_mask(length % 64));
+    }
+
+#   if BIT_ARRAY_HAS_MMAP
+    if (ba->mapped) {
+        uintptr_t const page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t const old_end = ((uintptr_t)ba + sizeof(BitArray)
+            + old_bytes + page_size - 1) & ~(page_size - 1);
+        uintptr_t const new_end = ((uintptr_t)ba + sizeof(BitArray)
+            + new_bytes + page_size - 1) & ~(page_size - 1);
+
+        // The pages already mapped are enough. The bytes past the storage in
+        // them are kept unset, so that growing again finds them unset.
+        if (new_end <= old_end) {
+            if (new_bytes < old_bytes) {
+                uintptr_t const kept_end = (uintptr_t)ba->data + old_bytes
+                    < new_end ? (uintptr_t)ba->data + old_bytes : new_end;
+                memset(ba->data + new_bytes, 0x00,
+                    kept_end - (uintptr_t)(ba->data + new_bytes));
+            }
+            if (new_end < old_end) {
+                munmap((void*)new_end, old_end - new_end);
+            }
+            // The pages are no longer split evenly across nodes.
+            ba->numa_nodes = 0;
+            ba->length_in_bits = length;
+            return ba;
+        }
+
+        BitArray* const moved = bitarray_map(length);
+        if (!moved) {
+            return NULL;
+        }
+
+        memcpy(moved->data, ba->data, old_bytes);
+        moved->length_in_bits = length;
+        munmap(ba, mapping_in_bytes(ba->length_in_bits));
+        return moved;
+    }
+
+    // Heap bitarrays growing past the threshold move to a mapping, as if
+    // constructed at their new length, falling back to the heap.
+    if (new_bytes > old_bytes && new_bytes >= BIT_ARRAY_MMAP_THRESHOLD) {
+        BitArray* const moved = bitarray_map(length);
+        if (moved) {
+            memcpy(moved->data, ba->data, old_bytes);
+            moved->length_in_bits = length;
+            free(ba);
+            return moved;
+        }
+    }
+#   endif
+
+    BitArray* const moved = realloc(ba, sizeof(BitArray) + new_bytes);
+    if (!moved) {
+        return NULL;
+    }
+
+    if (new_bytes > old_bytes) {
+        memset(moved->data + old_bytes, 0x00, new_bytes - old_bytes);
+    }
+    moved->numa_nodes = 0;
+    moved->length_in_bits = length;
+    return moved;
+}
+
 bool bitarray_check(BitArray const* const ba, size_t const bit_idx) {
 #   if BIT_ARRAY_ASSERTS
     assert(bit_idx < ba->length_in_bits);
@@ -104,6 +743,14 @@ bool bitarray_check(BitArray const* const ba, size_t const bit_idx) {
 }
 
 bool bitarray_all(BitArray const* const ba) {
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return bitarray_popcount(ba) == ba->length_in_bits;
+    }
+
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        return ba->popcount == ba->length_in_bits;
+    }
+
     uint8_t const* const last = bitarray_last(ba);
 
     for (uint8_t const* it = ba->data; it != last; ++it) {
@@ -116,6 +763,14 @@ bool bitarray_all(BitArray const* const ba) {
 }
 
 bool bitarray_any(BitArray const* const ba) {
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return seqlock_scan(ba, 0, bitarray_capacity(ba), bits_any, true);
+    }
+
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        return ba->popcount != 0;
+    }
+
     uint8_t const* const end = bitarray_end(ba);
 
     for (uint8_t const* it = ba->data; it != end; ++it) {
@@ -128,6 +783,14 @@ bool bitarray_any(BitArray const* const ba) {
 }
 
 bool bitarray_none(BitArray const* const ba) {
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return !seqlock_scan(ba, 0, bitarray_capacity(ba), bits_any, true);
+    }
+
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        return ba->popcount == 0;
+    }
+
     uint8_t const* const end = bitarray_end(ba);
 
     for (uint8_t const* it = ba->data; it != end; ++it) {
@@ -140,11 +803,73 @@ bool bitarray_none(BitArray const* const ba) {
 }
 
 size_t bitarray_popcount(BitArray const* const ba) {
-    size_t total_popcount = 0;
-    uint8_t const* const end = bitarray_end(ba);
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return seqlock_scan(ba, 0, bitarray_capacity(ba), bits_popcount,
+            false);
+    }
 
-    for (uint8_t const* it = ba->data; it != end; ++it) {
-        total_popcount += byte_popcount(*it);
+    if (ba->flags & BIT_ARRAY_COUNTED) {
+        return ba->popcount;
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        return bitarray_cached_popcount(
+            ba,
+            0,
+            bitarray_capacity_in_bytes(ba)
+        );
+    }
+
+    return bytes_popcount(ba->data, bitarray_end(ba));
+}
+
+size_t bitarray_popcount_range(
+    BitArray const* const ba,
+    size_t const first_bit,
+    size_t const last_bit
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(first_bit <= last_bit);
+    assert(last_bit <= ba->length_in_bits);
+#   endif
+
+    if (first_bit == last_bit) {
+        return 0;
+    }
+
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return seqlock_scan(ba, first_bit, last_bit, bits_popcount, false);
+    }
+
+    size_t const first_byte = first_bit / 8;
+    size_t const last_byte = last_bit / 8;
+    // Bits of the first byte in [first_bit, last_bit).
+    uint8_t head = ba->data[first_byte] & ~(byte_set_at(first_bit % 8) - 1);
+
+    if (first_byte == last_byte) {
+        head &= byte_set_at(last_bit % 8) - 1;
+        return byte_popcount(head);
+    }
+
+    size_t total_popcount = byte_popcount(head);
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        total_popcount += bitarray_cached_popcount(
+            ba,
+            first_byte + 1,
+            last_byte
+        );
+    } else {
+        total_popcount += bytes_popcount(
+            ba->data + first_byte + 1,
+            ba->data + last_byte
+        );
+    }
+
+    if (last_bit % 8) {
+        uint8_t const tail =
+            ba->data[last_byte] & (byte_set_at(last_bit % 8) - 1);
+        total_popcount += byte_popcount(tail);
     }
 
     return total_popcount;
@@ -163,6 +888,12 @@ void bitarray_set(BitArray* const ba, size_t const bit_idx) {
     assert(bit_idx < ba->length_in_bits);
 #   endif
 
+    if (ba->flags) {
+        uint8_t const byte = ba->data[bit_idx / 8] | byte_set_at(bit_idx % 8);
+        bitarray_store_byte(ba, bit_idx / 8, byte);
+        return;
+    }
+
     ba->data[bit_idx / 8] |= byte_set_at(bit_idx % 8);
 }
 
@@ -171,11 +902,25 @@ void bitarray_unset(BitArray* const ba, size_t const bit_idx) {
     assert(bit_idx < ba->length_in_bits);
 #   endif
 
+    if (ba->flags) {
+        uint8_t const byte = ba->data[bit_idx / 8] & ~byte_set_at(bit_idx % 8);
+        bitarray_store_byte(ba, bit_idx / 8, byte);
+        return;
+    }
+
     ba->data[bit_idx / 8] &= ~byte_set_at(bit_idx % 8);
 }
 
 void bitarray_fill(BitArray* const ba) {
-    memset(ba->data, 0xFF, (ba->length_in_bits - 1) / 8);
+    bitarray_fill_with(ba, BIT_ARRAY_STORE_AUTO);
+}
+
+void bitarray_fill_with(BitArray* const ba, BitArrayStoreHint const hint) {
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        seqlock_write_begin(ba, 0, bitarray_capacity_in_bytes(ba));
+    }
+
+    bytes_set(ba->data, 0xFF, (ba->length_in_bits - 1) / 8, hint);
 
     // Must not set unreachable bits to avoid incorrect checks
     // with bitarray_all/any/none().
@@ -186,10 +931,118 @@ void bitarray_fill(BitArray* const ba) {
     } else {
         *last = 0xFF;
     }
+
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        seqlock_write_end(ba, 0, bitarray_capacity_in_bytes(ba));
+    }
+
+    ba->popcount = ba->length_in_bits;
+
+    if (ba->flags & BIT_ARRAY_SCRATCH) {
+        ba->scratch->overflowed = true;
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        size_t const block_count = bitarray_block_count(ba);
+        size_t const block_bits = BIT_ARRAY_BLOCK_CACHE_BYTES * 8;
+
+        for (size_t block = 0; block != block_count - 1; ++block) {
+            ba->block_cache->popcounts[block] = block_bits;
+        }
+        ba->block_cache->popcounts[block_count - 1] =
+            ba->length_in_bits - (block_count - 1) * block_bits;
+
+        memset(ba->block_cache->dirty, 0x00,
+            (1 + (block_count - 1) / 64) * sizeof(uint64_t));
+    }
+}
+
+// Unsets every byte of the bitarray, honoring the store hint.
+static void bitarray_unset_bytes(
+    BitArray* const ba,
+    BitArrayStoreHint const hint
+) {
+#   if BIT_ARRAY_HAS_MMAP
+    // Discarding pages beats streaming zeroes into them. Discarded pages of a
+    // shared memory object are mapped back with their bits, though, and those
+    // placed by node would be faulted back on the node of the writer.
+    if (ba->mapped && !ba->shared && ba->numa_nodes <= 1
+        && hint == BIT_ARRAY_STORE_AUTO
+    ) {
+        bytes_discard(ba->data, ba->data + bitarray_capacity_in_bytes(ba));
+        return;
+    }
+#   endif
+
+    bytes_set(ba->data, 0x00, bitarray_capacity_in_bytes(ba), hint);
+}
+
+// Unsets the bits of the words touched since the last clear, which are the
+// only ones that may be set. Requires the touched list not to overflow.
+static void bitarray_clear_touched(BitArray* const ba) {
+    BitArrayScratch* const scratch = ba->scratch;
+    size_t const* const end = scratch->touched_words + scratch->count;
+
+    for (size_t const* it = scratch->touched_words; it != end; ++it) {
+        memset(ba->data + *it * 8, 0x00, 8);
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        // Blocks without touched words are already known to be unset.
+        for (size_t const* it = scratch->touched_words; it != end; ++it) {
+            size_t const block_idx = *it * 8 / BIT_ARRAY_BLOCK_CACHE_BYTES;
+            ba->block_cache->popcounts[block_idx] = 0;
+            ba->block_cache->dirty[block_idx / 64] &=
+                ~(UINT64_C(1) << (block_idx % 64));
+        }
+    }
+
+    scratch->count = 0;
+    ba->popcount = 0;
 }
 
 void bitarray_clear(BitArray* const ba) {
-    memset(ba->data, 0x00, bitarray_capacity_in_bytes(ba));
+    bitarray_clear_with(ba, BIT_ARRAY_STORE_AUTO);
+}
+
+// Unsets every bit, updating the bookkeeping of every enabled mode but
+// seqlock mode.
+static void bitarray_clear_bits(
+    BitArray* const ba,
+    BitArrayStoreHint const hint
+) {
+    if ((ba->flags & BIT_ARRAY_SCRATCH) && !ba->scratch->overflowed) {
+        bitarray_clear_touched(ba);
+        return;
+    }
+
+    bitarray_unset_bytes(ba, hint);
+    ba->popcount = 0;
+
+    if (ba->flags & BIT_ARRAY_SCRATCH) {
+        ba->scratch->count = 0;
+        ba->scratch->overflowed = false;
+    }
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        size_t const block_count = bitarray_block_count(ba);
+
+        memset(ba->block_cache->popcounts, 0x00,
+            block_count * sizeof(size_t));
+        memset(ba->block_cache->dirty, 0x00,
+            (1 + (block_count - 1) / 64) * sizeof(uint64_t));
+    }
+}
+
+void bitarray_clear_with(BitArray* const ba, BitArrayStoreHint const hint) {
+    if (!(ba->flags & BIT_ARRAY_SEQLOCKED)) {
+        bitarray_clear_bits(ba, hint);
+        return;
+    }
+
+    seqlock_write_begin(ba, 0, bitarray_capacity_in_bytes(ba));
+    bitarray_clear_bits(ba, hint);
+    seqlock_write_end(ba, 0, bitarray_capacity_in_bytes(ba));
 }
 
 void bitarray_flip(BitArray* const ba, size_t const bit_idx) {
@@ -197,5 +1050,447 @@ void bitarray_flip(BitArray* const ba, size_t const bit_idx) {
     assert(bit_idx < ba->length_in_bits);
 #   endif
 
+    if (ba->flags) {
+        uint8_t const byte = ba->data[bit_idx / 8] ^ byte_set_at(bit_idx % 8);
+        bitarray_store_byte(ba, bit_idx / 8, byte);
+        return;
+    }
+
     ba->data[bit_idx / 8] ^= byte_set_at(bit_idx % 8);
 }
+
+// Returns the byte of the bit at the index, for atomic operations.
+static inline _Atomic uint8_t* bitarray_atomic_byte(
+    BitArray const* const ba,
+    size_t const bit_idx
+) {
+    return (_Atomic uint8_t*)(ba->data + bit_idx / 8);
+}
+
+bool bitarray_atomic_check(BitArray const* const ba, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < ba->length_in_bits);
+#   endif
+
+    return atomic_load_explicit(
+        bitarray_atomic_byte(ba, bit_idx),
+        memory_order_acquire
+    ) & byte_set_at(bit_idx % 8);
+}
+
+bool bitarray_atomic_set(BitArray* const ba, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < ba->length_in_bits);
+    assert(!ba->flags);
+#   endif
+
+    return atomic_fetch_or_explicit(
+        bitarray_atomic_byte(ba, bit_idx),
+        byte_set_at(bit_idx % 8),
+        memory_order_acq_rel
+    ) & byte_set_at(bit_idx % 8);
+}
+
+bool bitarray_atomic_unset(BitArray* const ba, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < ba->length_in_bits);
+    assert(!ba->flags);
+#   endif
+
+    return atomic_fetch_and_explicit(
+        bitarray_atomic_byte(ba, bit_idx),
+        (uint8_t)~byte_set_at(bit_idx % 8),
+        memory_order_acq_rel
+    ) & byte_set_at(bit_idx % 8);
+}
+
+bool bitarray_atomic_flip(BitArray* const ba, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < ba->length_in_bits);
+    assert(!ba->flags);
+#   endif
+
+    return atomic_fetch_xor_explicit(
+        bitarray_atomic_byte(ba, bit_idx),
+        byte_set_at(bit_idx % 8),
+        memory_order_acq_rel
+    ) & byte_set_at(bit_idx % 8);
+}
+
+// Returns the bit at the index as the lowest bit of a word.
+static inline uint64_t bitarray_probe(
+    BitArray const* const ba,
+    size_t const bit_idx
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < ba->length_in_bits);
+#   endif
+
+    return (ba->data[bit_idx / 8] >> (bit_idx % 8)) & 1u;
+}
+
+void bitarray_check_batch(
+    BitArray const* const ba,
+    size_t const* const indices,
+    size_t const count,
+    BitArray* const out
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(ba != out);
+    assert(count <= out->length_in_bits);
+#   endif
+
+    if (!count) {
+        return;
+    }
+
+    size_t const bytes = 1 + (count - 1) / 8;
+    if (out->flags) {
+        bitarray_bytes_will_change(out, 0, bytes);
+    }
+
+    // The results are gathered a word at a time, while the bytes of the next
+    // indices are on their way.
+    uint64_t word = 0;
+    size_t i = 0;
+    for (; i + BIT_ARRAY_PREFETCH_DISTANCE < count; ++i) {
+        prefetch_read(ba->data + indices[i + BIT_ARRAY_PREFETCH_DISTANCE] / 8);
+        word |= bitarray_probe(ba, indices[i]) << (i % 64);
+        if (i % 64 == 63) {
+            store_word(out->data + 8 * (i / 64), word);
+            word = 0;
+        }
+    }
+    for (; i != count; ++i) {
+        word |= bitarray_probe(ba, indices[i]) << (i % 64);
+        if (i % 64 == 63) {
+            store_word(out->data + 8 * (i / 64), word);
+            word = 0;
+        }
+    }
+
+    if (count % 64) {
+        uint8_t* const last = out->data + 8 * (count / 64);
+        store_word(last,
+            (load_word(last) & ~low_bits_mask((unsigned)(count % 64))) | word);
+    }
+
+    if (out->flags) {
+        bitarray_bytes_did_change(out, 0, bytes);
+    }
+}
+
+void bitarray_set_batch(
+    BitArray* const ba,
+    size_t const* const indices,
+    size_t const count
+) {
+    if (!ba->flags
+        && storage_in_bytes(ba->length_in_bits) >= BIT_ARRAY_PARTITION_THRESHOLD
+        && bitarray_set_partitioned(ba, indices, count)
+    ) {
+        return;
+    }
+
+    size_t i = 0;
+    for (; i + BIT_ARRAY_PREFETCH_DISTANCE < count; ++i) {
+        prefetch_write(ba->data + indices[i + BIT_ARRAY_PREFETCH_DISTANCE] / 8);
+        bitarray_set(ba, indices[i]);
+    }
+    for (; i != count; ++i) {
+        bitarray_set(ba, indices[i]);
+    }
+}
+
+void bitarray_enable_counting(BitArray* const ba) {
+#   if BIT_ARRAY_ASSERTS
+    assert(!ba->shared);
+#   else
+    // The header is shared with other processes, which cannot follow its
+    // pointers.
+    if (ba->shared) {
+        return;
+    }
+#   endif
+
+    if (!(ba->flags & BIT_ARRAY_COUNTED)) {
+        ba->popcount = bitarray_popcount(ba);
+        ba->flags |= BIT_ARRAY_COUNTED;
+    }
+}
+
+void bitarray_disable_counting(BitArray* const ba) {
+    ba->flags &= ~BIT_ARRAY_COUNTED;
+}
+
+bool bitarray_is_counting(BitArray const* const ba) {
+    return ba->flags & BIT_ARRAY_COUNTED;
+}
+
+bool bitarray_enable_block_cache(BitArray* const ba) {
+#   if BIT_ARRAY_ASSERTS
+    assert(!ba->shared);
+#   else
+    // The header is shared with other processes, which cannot follow its
+    // pointers.
+    if (ba->shared) {
+        return false;
+    }
+#   endif
+
+    if (ba->flags & BIT_ARRAY_BLOCK_CACHED) {
+        return true;
+    }
+
+    size_t const block_count = bitarray_block_count(ba);
+    size_t const dirty_words = 1 + (block_count - 1) / 64;
+    BitArrayBlockCache* const cache = malloc(
+        sizeof(BitArrayBlockCache)
+        + block_count * sizeof(size_t)
+        + dirty_words * sizeof(uint64_t)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(cache);
+#   else
+    if (!cache) {
+        return false;
+    }
+#   endif
+
+    // Every block starts dirty, so the first count fills the cache.
+    cache->dirty = (uint64_t*)(cache->popcounts + block_count);
+    memset(cache->dirty, 0xFF, dirty_words * sizeof(uint64_t));
+
+    ba->block_cache = cache;
+    ba->flags |= BIT_ARRAY_BLOCK_CACHED;
+
+    return true;
+}
+
+void bitarray_disable_block_cache(BitArray* const ba) {
+    free(ba->block_cache);
+    ba->block_cache = NULL;
+    ba->flags &= ~BIT_ARRAY_BLOCK_CACHED;
+}
+
+bool bitarray_enable_scratch(BitArray* const ba) {
+#   if BIT_ARRAY_ASSERTS
+    assert(!ba->shared);
+#   else
+    // The header is shared with other processes, which cannot follow its
+    // pointers.
+    if (ba->shared) {
+        return false;
+    }
+#   endif
+
+    if (ba->flags & BIT_ARRAY_SCRATCH) {
+        return true;
+    }
+
+    // Past this many touched words, rewriting the whole bitarray is cheap in
+    // comparison.
+    size_t const word_count = storage_in_bytes(ba->length_in_bits) / 8;
+    size_t const capacity = word_count / 32 < 64 ? 64 : word_count / 32;
+    BitArrayScratch* const scratch = malloc(
+        sizeof(BitArrayScratch) + capacity * sizeof(size_t)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(scratch);
+#   else
+    if (!scratch) {
+        return false;
+    }
+#   endif
+
+    scratch->count = 0;
+    scratch->capacity = capacity;
+    // Bits set before scratch mode was enabled were not recorded.
+    scratch->overflowed = bitarray_any(ba);
+
+    ba->scratch = scratch;
+    ba->flags |= BIT_ARRAY_SCRATCH;
+
+    return true;
+}
+
+void bitarray_disable_scratch(BitArray* const ba) {
+    free(ba->scratch);
+    ba->scratch = NULL;
+    ba->flags &= ~BIT_ARRAY_SCRATCH;
+}
+
+bool bitarray_enable_seqlock(BitArray* const ba) {
+#   if BIT_ARRAY_ASSERTS
+    assert(!ba->shared);
+#   else
+    // The header is shared with other processes, which cannot follow its
+    // pointers.
+    if (ba->shared) {
+        return false;
+    }
+#   endif
+
+    if (ba->flags & BIT_ARRAY_SEQLOCKED) {
+        return true;
+    }
+
+    size_t const chunk_count = 1 + (bitarray_capacity_in_bytes(ba) - 1)
+        / BIT_ARRAY_SEQLOCK_CHUNK_BYTES;
+    BitArraySeqlock* const seqlock = malloc(
+        sizeof(BitArraySeqlock) + chunk_count * sizeof(atomic_size_t)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(seqlock);
+#   else
+    if (!seqlock) {
+        return false;
+    }
+#   endif
+
+    seqlock->chunk_count = chunk_count;
+    for (size_t chunk = 0; chunk != chunk_count; ++chunk) {
+        atomic_init(seqlock->sequences + chunk, 0);
+    }
+
+    ba->seqlock = seqlock;
+    ba->flags |= BIT_ARRAY_SEQLOCKED;
+
+    return true;
+}
+
+void bitarray_disable_seqlock(BitArray* const ba) {
+    free(ba->seqlock);
+    ba->seqlock = NULL;
+    ba->flags &= ~BIT_ARRAY_SEQLOCKED;
+}
+
+uint64_t bitarray_get_bits(
+    BitArray const* const ba,
+    size_t const offset,
+    unsigned const width
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+    assert(offset <= ba->length_in_bits);
+    assert(width <= ba->length_in_bits - offset);
+#   endif
+
+    return read_bits(ba->data, offset, width);
+}
+
+void bitarray_set_bits(
+    BitArray* const ba,
+    size_t const offset,
+    unsigned const width,
+    uint64_t const value
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+    assert(offset <= ba->length_in_bits);
+    assert(width <= ba->length_in_bits - offset);
+#   endif
+
+    if (!ba->flags) {
+        write_bits(ba->data, offset, width, value);
+        return;
+    }
+
+    // Goes through the bookkeeping of the modes one byte at a time.
+    size_t const last_bit = offset + width;
+    size_t bit_idx = offset;
+    while (bit_idx != last_bit) {
+        size_t const byte_idx = bit_idx / 8;
+        unsigned const shift = bit_idx % 8;
+        unsigned const count =
+            last_bit - bit_idx < 8u - shift ? last_bit - bit_idx : 8u - shift;
+        uint8_t const mask = (uint8_t)(((1u << count) - 1) << shift);
+        uint8_t const bits = (uint8_t)((value >> (bit_idx - offset)) << shift);
+
+        bitarray_store_byte(
+            ba,
+            byte_idx,
+            (ba->data[byte_idx] & ~mask) | (bits & mask)
+        );
+        bit_idx += count;
+    }
+}
+
+void bitarray_get_bits_strided(
+    BitArray const* const ba,
+    size_t const offset,
+    unsigned const width,
+    size_t const stride,
+    size_t const count,
+    uint64_t* const dst
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+    assert(!count || (offset <= ba->length_in_bits
+        && width <= ba->length_in_bits - offset));
+    assert(!count || !stride
+        || (ba->length_in_bits - offset - width) / stride >= count - 1);
+#   endif
+
+    size_t field = offset;
+    for (size_t i = 0; i != count; ++i) {
+        dst[i] = read_bits(ba->data, field, width);
+        field += stride;
+    }
+}
+
+void bitarray_set_bits_strided(
+    BitArray* const ba,
+    size_t const offset,
+    unsigned const width,
+    size_t const stride,
+    size_t const count,
+    uint64_t const* const src
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+    assert(!count || (offset <= ba->length_in_bits
+        && width <= ba->length_in_bits - offset));
+    assert(!count || !stride
+        || (ba->length_in_bits - offset - width) / stride >= count - 1);
+#   endif
+
+    if (!count) {
+        return;
+    }
+
+    size_t const first_byte = offset / 8;
+    size_t const last_bit = offset + (count - 1) * stride + width;
+    size_t const last_byte = (last_bit - 1) / 8 + 1;
+
+    if (ba->flags) {
+        bitarray_bytes_will_change(ba, first_byte, last_byte);
+    }
+
+    size_t field = offset;
+    for (size_t i = 0; i != count; ++i) {
+        write_bits(ba->data, field, width, src[i]);
+        field += stride;
+    }
+
+    if (ba->flags) {
+        bitarray_bytes_did_change(ba, first_byte, last_byte);
+    }
+}
+
+void bitarray_for_each_set(
+    BitArray const* const ba,
+    void (*const fn)(size_t bit_idx, void* ctx),
+    void* const ctx
+) {
+    words_for_each_set(
+        ba,
+        0,
+        storage_in_bytes(ba->length_in_bits) / 8,
+        fn,
+        ctx
+    );
+}
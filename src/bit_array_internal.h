@@ -0,0 +1,387 @@
+#ifndef BIT_ARRAY_INTERNAL_H
+#define BIT_ARRAY_INTERNAL_H
+
+// Layout of a bitarray and helpers shared by the translation units of the
+// library. Not part of the public interface.
+
+#include "bit_array.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BIT_ARRAY_USE_SIMD && defined(__BMI2__)
+#   include <immintrin.h>
+#endif
+
+static_assert(CHAR_BIT == 8, "Expected a byte to consist exactly of 8 bits.");
+
+// Bit flags describing the optional modes enabled on a bitarray.
+enum {
+    // The popcount field is kept up to date on every write.
+    BIT_ARRAY_COUNTED = 0x01u,
+    // Writes mark their block dirty in the block cache.
+    BIT_ARRAY_BLOCK_CACHED = 0x02u,
+    // Writes record the words they make non-zero, so that clearing only
+    // rewrites those.
+    BIT_ARRAY_SCRATCH = 0x04u,
+    // Writes bump the sequence counters of the chunks they change, so that
+    // concurrent readers can detect and rescan them.
+    BIT_ARRAY_SEQLOCKED = 0x08u,
+};
+
+// Popcount of every BIT_ARRAY_BLOCK_CACHE_BYTES sized block of a bitarray.
+// The popcount of a block is stale while its dirty bit is set.
+typedef struct BitArrayBlockCache {
+    // One bit per block.
+    uint64_t* dirty;
+    size_t popcounts[];
+} BitArrayBlockCache;
+
+// Indices of the 64-bit words of a bitarray written since it was last
+// cleared. Once more than capacity words are touched, the list overflows and
+// the next clear falls back to rewriting the whole bitarray.
+typedef struct BitArrayScratch {
+    size_t count;
+    size_t capacity;
+    bool overflowed;
+    size_t touched_words[];
+} BitArrayScratch;
+
+// Sequence counter of every BIT_ARRAY_SEQLOCK_CHUNK_BYTES sized chunk of a
+// bitarray. A counter is odd while a write to its chunk is in progress.
+typedef struct BitArraySeqlock {
+    size_t chunk_count;
+    atomic_size_t sequences[];
+} BitArraySeqlock;
+
+struct BitArray {
+    size_t length_in_bits;
+    // Number of set bits. Only meaningful in counted mode.
+    size_t popcount;
+    // Only allocated in block cached mode.
+    BitArrayBlockCache* block_cache;
+    // Only allocated in scratch mode.
+    BitArrayScratch* scratch;
+    // Only allocated in seqlock mode.
+    BitArraySeqlock* seqlock;
+    // Whether the bitarray lives in a memory mapping rather than on the heap.
+    bool mapped;
+    // Whether the mapping is a shared memory object, whose pages cannot be
+    // discarded and whose header other processes read.
+    bool shared;
+    // Number of nodes the pages of the mapping are split evenly across, in
+    // the order they are online. Zero unless placed by node.
+    unsigned numa_nodes;
+    unsigned flags;
+    uint8_t data[];
+};
+
+// Returns a byte where every bit except the one at bit_idx is unset.
+// Does not check whether bit_idx is in the interval [0, 8).
+// Index starts from the right.
+// byte_set_at(2) = b00000100
+static inline uint8_t byte_set_at(size_t const bit_idx) {
+    return UINT8_C(0x01u) << bit_idx;
+}
+
+static inline size_t bitarray_capacity_in_bytes(BitArray const* const ba) {
+    return 1 + (ba->length_in_bits - 1) / 8;
+}
+
+// Returns the number of bytes allocated for the bits of a bitarray of the
+// given length. Rounded up to whole 64-bit words, whose padding bytes are
+// always unset.
+static inline size_t storage_in_bytes(size_t const length) {
+    return 8 * (1 + (length - 1) / 64);
+}
+
+// Returns the 64-bit word whose bit i is the bit at index i of the 8 bytes
+// starting at bytes.
+static inline uint64_t load_word(uint8_t const* const bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+#   if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#   endif
+    return word;
+}
+
+// Stores the 64-bit word so that bit i of the word becomes the bit at index i
+// of the 8 bytes starting at bytes.
+static inline void store_word(uint8_t* const bytes, uint64_t word) {
+#   if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#   endif
+    memcpy(bytes, &word, sizeof(word));
+}
+
+// Returns the 64-bit word at word_idx. Word loads are allowed anywhere in the
+// storage of the bitarray, including its padding.
+static inline uint64_t bitarray_load_word(
+    BitArray const* const ba,
+    size_t const word_idx
+) {
+    return load_word(ba->data + word_idx * 8);
+}
+
+// Returns the mask of the lowest width bits of a word, where width belongs to
+// the interval [1, 64].
+static inline uint64_t low_bits_mask(unsigned const width) {
+    return ~UINT64_C(0) >> (64 - width);
+}
+
+// Returns the width bits starting at the bit offset of the words at data,
+// where width belongs to the interval [1, 64]. The first of them is the lowest
+// bit of the result. Only loads the one or two words the bits straddle.
+static inline uint64_t read_bits(
+    uint8_t const* const data,
+    size_t const offset,
+    unsigned const width
+) {
+    uint8_t const* const word = data + offset / 64 * 8;
+    unsigned const shift = offset % 64;
+    uint64_t value = load_word(word) >> shift;
+
+    if (shift + width > 64) {
+        value |= load_word(word + 8) << (64 - shift);
+    }
+
+    return value & low_bits_mask(width);
+}
+
+// Replaces the width bits starting at the bit offset of the words at data by
+// the lowest width bits of value, where width belongs to the interval
+// [1, 64]. Only loads and stores the one or two words the bits straddle.
+static inline void write_bits(
+    uint8_t* const data,
+    size_t const offset,
+    unsigned const width,
+    uint64_t const value
+) {
+    uint8_t* const word = data + offset / 64 * 8;
+    unsigned const shift = offset % 64;
+    uint64_t const mask = low_bits_mask(width);
+    uint64_t const bits = value & mask;
+
+    store_word(word, (load_word(word) & ~(mask << shift)) | (bits << shift));
+
+    if (shift + width > 64) {
+        unsigned const low_width = 64 - shift;
+        store_word(word + 8, (load_word(word + 8) & ~(mask >> low_width))
+            | (bits >> low_width));
+    }
+}
+
+// Hints the cache to load the line holding the byte, ahead of a read. Does
+// nothing on compilers without the hint.
+static inline void prefetch_read(void const* const byte) {
+#   if defined(__GNUC__)
+    __builtin_prefetch(byte, 0);
+#   else
+    (void)byte;
+#   endif
+}
+
+// Hints the cache to load the line holding the byte, ahead of a write.
+static inline void prefetch_write(void const* const byte) {
+#   if defined(__GNUC__)
+    __builtin_prefetch(byte, 1);
+#   else
+    (void)byte;
+#   endif
+}
+
+// Returns the number of set bits in a word.
+static inline unsigned word_popcount(uint64_t word) {
+#   if BIT_ARRAY_USE_BUILTIN_POPCOUNT
+    return (unsigned)__builtin_popcountll(word);
+#   else
+    word -= (word >> 1) & UINT64_C(0x5555555555555555);
+    word = (word & UINT64_C(0x3333333333333333))
+        + ((word >> 2) & UINT64_C(0x3333333333333333));
+    word = (word + (word >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    return (unsigned)((word * UINT64_C(0x0101010101010101)) >> 56);
+#   endif
+}
+
+// Returns the index of the lowest set bit of a word. The word must not be
+// zero.
+static inline unsigned word_lowest_set(uint64_t const word) {
+#   if BIT_ARRAY_USE_BUILTIN_POPCOUNT
+    return (unsigned)__builtin_ctzll(word);
+#   else
+    // Counts the unset bits below the lowest set bit.
+    return word_popcount((word & (~word + 1)) - 1);
+#   endif
+}
+
+// Returns the index of the highest set bit of a word. The word must not be
+// zero.
+static inline unsigned word_highest_set(uint64_t word) {
+#   if BIT_ARRAY_USE_BUILTIN_POPCOUNT
+    return 63u - (unsigned)__builtin_clzll(word);
+#   else
+    // Sets every bit below the highest set bit, then counts them.
+    word |= word >> 1;
+    word |= word >> 2;
+    word |= word >> 4;
+    word |= word >> 8;
+    word |= word >> 16;
+    word |= word >> 32;
+    return word_popcount(word) - 1;
+#   endif
+}
+
+// Returns the index of the set bit of a word preceded by rank other set bits.
+// The word must have more than rank set bits.
+static inline unsigned word_select(uint64_t word, unsigned rank) {
+#   if BIT_ARRAY_USE_SIMD && defined(__BMI2__)
+    return word_lowest_set(_pdep_u64(UINT64_C(1) << rank, word));
+#   else
+    // Skips whole bytes, then unsets the lowest set bits of the right byte.
+    unsigned shift = 0;
+    for (;; shift += 8) {
+        unsigned const count = word_popcount((word >> shift) & 0xFFu);
+        if (rank < count) {
+            break;
+        }
+        rank -= count;
+    }
+
+    word >>= shift;
+    for (; rank; --rank) {
+        word &= word - 1;
+    }
+    return shift + word_lowest_set(word);
+#   endif
+}
+
+// Calls fn on the index of every set bit of the words of the bitarray in the
+// interval [first_word, last_word), in order.
+static inline void words_for_each_set(
+    BitArray const* const ba,
+    size_t const first_word,
+    size_t const last_word,
+    void (*const fn)(size_t bit_idx, void* ctx),
+    void* const ctx
+) {
+    for (size_t word_idx = first_word; word_idx != last_word; ++word_idx) {
+        uint64_t word = bitarray_load_word(ba, word_idx);
+        for (; word; word &= word - 1) {
+            fn(64 * word_idx + word_lowest_set(word), ctx);
+        }
+    }
+}
+
+// Returns a pointer to the byte following the last byte of the bitarray.
+static inline uint8_t const* bitarray_end(BitArray const* const ba) {
+    return ba->data + bitarray_capacity_in_bytes(ba);
+}
+
+// Returns a pointer to the last byte of the bitarray.
+static inline uint8_t const* bitarray_last(BitArray const* const ba) {
+    return ba->data + (ba->length_in_bits - 1) / 8;
+}
+
+// Returns a mutable pointer to the last byte of the bitarray.
+static inline uint8_t* bitarray_last_mut(BitArray* const ba) {
+    return ba->data + (ba->length_in_bits - 1) / 8;
+}
+
+// Must be called before rewriting the bytes in the interval
+// [first_byte, last_byte) directly, if any mode is enabled.
+void bitarray_bytes_will_change(
+    BitArray* ba,
+    size_t first_byte,
+    size_t last_byte
+);
+
+// Must be called after rewriting the bytes in the interval
+// [first_byte, last_byte) directly, if any mode is enabled.
+void bitarray_bytes_did_change(
+    BitArray* ba,
+    size_t first_byte,
+    size_t last_byte
+);
+
+// Changes the length of a bitarray with no mode enabled, keeping its bits up
+// to the shorter of both lengths and unsetting the others. The bitarray may
+// move, in which case the old pointer becomes invalid. Heap bitarrays
+// growing past BIT_ARRAY_MMAP_THRESHOLD bytes move to a mapping. Returns the
+// resized bitarray, or NULL, leaving the bitarray untouched, if an error
+// occurs allocating memory.
+BitArray* bitarray_resize(BitArray* ba, size_t length);
+
+// Maps zeroed pages for a bitarray of the given length, whose header and
+// bits then share the mapping. Returns NULL if the mapping fails. Only
+// defined on Linux.
+BitArray* bitarray_map(size_t length);
+
+// Constructs the rank and select directory of a bitarray from its counts,
+// laid out as in rank_select.c: for each of the length / 512 + 1
+// superblocks, the number of set bits preceding it, then the numbers of set
+// bits from its start to its words 1 to 7, 9 bits each. Takes ownership of
+// counts, deallocated along with the directory, or right away if an error
+// occurs allocating memory, in which case NULL is returned.
+struct RankSelect* rankselect_with_counts(
+    BitArray const* ba,
+    uint64_t* counts,
+    size_t ones
+);
+
+// Calls fn once for every thread index in the interval [0, threads), each on
+// its own thread, the first one on the calling thread, and waits for all of
+// them to return. Runs the calls on the calling thread if threads cannot be
+// created.
+void bitarray_run_parallel(
+    unsigned threads,
+    void (*fn)(void* ctx, unsigned thread, unsigned threads),
+    void* ctx
+);
+
+// Sets the bits at the indices of a batch, for a bitarray with no mode
+// enabled, by splitting the indices into buckets by their high bits, then
+// applying one bucket at a time, the bytes it updates staying in the cache
+// meanwhile. Returns false, leaving the bitarray untouched, if the batch is
+// too small to be worth it, or if an error occurs allocating memory.
+bool bitarray_set_partitioned(
+    BitArray* ba,
+    size_t const* indices,
+    size_t count
+);
+
+// Returns the index of the NUMA chunk of the bitarray, as numbered by
+// bitarray_numa_chunk, holding the words the thread works on.
+unsigned bitarray_thread_chunk(
+    BitArray const* ba,
+    unsigned thread,
+    unsigned threads
+);
+
+// Returns the words of the bitarray a thread works on, in the interval
+// [*first_word, *last_word). The threads share the NUMA chunks evenly, in
+// order, each thread staying within a chunk when there are enough of them,
+// and split every chunk evenly, so that their words cover the bitarray.
+void bitarray_thread_words(
+    BitArray const* ba,
+    unsigned thread,
+    unsigned threads,
+    size_t* first_word,
+    size_t* last_word
+);
+
+// Runs the calls as bitarray_run_parallel does, pinning the thread of every
+// call to the home node of the words bitarray_thread_words gives it, when
+// the bitarray is split across nodes. The calling thread gets its CPUs back
+// afterwards.
+void bitarray_run_placed(
+    BitArray const* ba,
+    unsigned threads,
+    void (*fn)(void* ctx, unsigned thread, unsigned threads),
+    void* ctx
+);
+
+#endif  // BIT_ARRAY_INTERNAL_H
@@ -0,0 +1,1227 @@
+#include "bit_array_kernels.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BIT_ARRAY_USE_SIMD && defined(__SSE2__)
+#   include <immintrin.h>
+#endif
+
+static_assert(sizeof(bool) == 1, "Expected a boolean to fit in a byte.");
+
+// Sets the bit at index i of bits if bytes[i] is not zero, and unsets it
+// otherwise, for every i in [0, count). Rewrites whole bytes of bits.
+static void pack_nonzero(
+    uint8_t* const bits,
+    uint8_t const* const bytes,
+    size_t const count
+) {
+    size_t i = 0;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX512BW__)
+    for (; i + 64 <= count; i += 64) {
+        __m512i const chunk = _mm512_loadu_si512(bytes + i);
+        uint64_t const mask = _mm512_test_epi8_mask(chunk, chunk);
+        memcpy(bits + i / 8, &mask, sizeof(mask));
+    }
+#   elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+    __m256i const zero = _mm256_setzero_si256();
+    for (; i + 32 <= count; i += 32) {
+        __m256i const chunk =
+            _mm256_loadu_si256((__m256i const*)(bytes + i));
+        uint32_t const mask =
+            ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, zero));
+        memcpy(bits + i / 8, &mask, sizeof(mask));
+    }
+#   elif BIT_ARRAY_USE_SIMD && defined(__SSE2__)
+    __m128i const zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i const chunk = _mm_loadu_si128((__m128i const*)(bytes + i));
+        uint16_t const mask =
+            ~(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+        memcpy(bits + i / 8, &mask, sizeof(mask));
+    }
+#   endif
+
+    for (; i < count; i += 8) {
+        size_t const remaining = count - i < 8 ? count - i : 8;
+        uint8_t byte = 0;
+
+        for (size_t j = 0; j != remaining; ++j) {
+            byte |= (uint8_t)(bytes[i + j] != 0) << j;
+        }
+
+        bits[i / 8] = byte;
+    }
+}
+
+// Sets bytes[i] to one if the bit at index i of bits is set, and to zero
+// otherwise, for every i in [0, count).
+static void unpack_bytes(
+    uint8_t* const bytes,
+    uint8_t const* const bits,
+    size_t const count,
+    uint8_t const one
+) {
+    size_t i = 0;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX512BW__)
+    __m512i const ones = _mm512_set1_epi8((char)one);
+    for (; i + 64 <= count; i += 64) {
+        uint64_t mask;
+        memcpy(&mask, bits + i / 8, sizeof(mask));
+        _mm512_storeu_si512(bytes + i, _mm512_maskz_mov_epi8(mask, ones));
+    }
+#   elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+    __m256i const ones = _mm256_set1_epi8((char)one);
+    // Byte j of each chunk is tested against bit j % 8 of mask byte j / 8.
+    __m256i const spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3
+    );
+    __m256i const bit = _mm256_set1_epi64x((long long)0x8040201008040201);
+    for (; i + 32 <= count; i += 32) {
+        uint32_t mask;
+        memcpy(&mask, bits + i / 8, sizeof(mask));
+        __m256i chunk =
+            _mm256_shuffle_epi8(_mm256_set1_epi32((int)mask), spread);
+        chunk = _mm256_cmpeq_epi8(_mm256_and_si256(chunk, bit), bit);
+        _mm256_storeu_si256(
+            (__m256i*)(bytes + i),
+            _mm256_and_si256(chunk, ones)
+        );
+    }
+#   elif BIT_ARRAY_USE_SIMD && defined(__BMI2__)
+    for (; i + 8 <= count; i += 8) {
+        // Deposits each bit in the lowest bit of its own byte.
+        uint64_t const chunk =
+            _pdep_u64(bits[i / 8], UINT64_C(0x0101010101010101)) * one;
+        memcpy(bytes + i, &chunk, sizeof(chunk));
+    }
+#   endif
+
+    for (; i < count; ++i) {
+        bytes[i] = (bits[i / 8] & byte_set_at(i % 8)) ? one : 0x00;
+    }
+}
+
+BitArray* bitarray_from_bools(bool const* const bools, size_t const length) {
+    return bitarray_from_bytes_nonzero((uint8_t const*)bools, length);
+}
+
+BitArray* bitarray_from_bytes_nonzero(
+    uint8_t const* const bytes,
+    size_t const length
+) {
+    BitArray* const ba = bitarray_with_capacity(length);
+
+    if (ba) {
+        pack_nonzero(ba->data, bytes, length);
+    }
+
+    return ba;
+}
+
+void bitarray_to_bools(BitArray const* const ba, bool* const bools) {
+    unpack_bytes((uint8_t*)bools, ba->data, ba->length_in_bits, 0x01);
+}
+
+void bitarray_to_bytes(BitArray const* const ba, uint8_t* const bytes) {
+    unpack_bytes(bytes, ba->data, ba->length_in_bits, 0xFF);
+}
+
+// Replaces the word at bytes by its combination with mask.
+static inline void combine_word(
+    uint8_t* const bytes,
+    uint64_t const mask,
+    BitArrayCombine const combine
+) {
+    switch (combine) {
+    case BIT_ARRAY_ASSIGN:
+        store_word(bytes, mask);
+        return;
+    case BIT_ARRAY_AND:
+        store_word(bytes, load_word(bytes) & mask);
+        return;
+    case BIT_ARRAY_OR:
+        store_word(bytes, load_word(bytes) | mask);
+        return;
+    }
+}
+
+// Defines name(a, b), which returns the word whose bit j is set if
+// compare(a[j], b[j]) holds, for every j in [0, 64). Compares lanes elements
+// at a time, and movemask turns the result of compare into lanes bits.
+#define DEFINE_MASK64(name, type, lanes, load, compare, movemask)            \
+    static inline uint64_t name(                                             \
+        type const* const a,                                                 \
+        type const* const b                                                  \
+    ) {                                                                      \
+        uint64_t mask = 0;                                                   \
+        for (size_t j = 0; j != 64; j += (lanes)) {                          \
+            mask |= (uint64_t)movemask(compare(load(a + j), load(b + j)))    \
+                << j;                                                        \
+        }                                                                    \
+        return mask;                                                         \
+    }
+
+#if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+#   define LOAD_I32(p) _mm512_loadu_si512((void const*)(p))
+#   define LOAD_I64(p) _mm512_loadu_si512((void const*)(p))
+#   define LOAD_F32(p) _mm512_loadu_ps(p)
+#   define LOAD_F64(p) _mm512_loadu_pd(p)
+#   define EQ_I32(x, y) _mm512_cmpeq_epi32_mask(x, y)
+#   define LT_I32(x, y) _mm512_cmplt_epi32_mask(x, y)
+#   define LE_I32(x, y) _mm512_cmple_epi32_mask(x, y)
+#   define EQ_I64(x, y) _mm512_cmpeq_epi64_mask(x, y)
+#   define LT_I64(x, y) _mm512_cmplt_epi64_mask(x, y)
+#   define LE_I64(x, y) _mm512_cmple_epi64_mask(x, y)
+#   define EQ_F32(x, y) _mm512_cmp_ps_mask(x, y, _CMP_EQ_OQ)
+#   define LT_F32(x, y) _mm512_cmp_ps_mask(x, y, _CMP_LT_OQ)
+#   define LE_F32(x, y) _mm512_cmp_ps_mask(x, y, _CMP_LE_OQ)
+#   define EQ_F64(x, y) _mm512_cmp_pd_mask(x, y, _CMP_EQ_OQ)
+#   define LT_F64(x, y) _mm512_cmp_pd_mask(x, y, _CMP_LT_OQ)
+#   define LE_F64(x, y) _mm512_cmp_pd_mask(x, y, _CMP_LE_OQ)
+#   define MOVEMASK_I32(m) (m)
+#   define MOVEMASK_I64(m) (m)
+#   define MOVEMASK_F32(m) (m)
+#   define MOVEMASK_F64(m) (m)
+#   define LANES_32 16
+#   define LANES_64 8
+#elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+#   define LOAD_I32(p) _mm256_loadu_si256((__m256i const*)(p))
+#   define LOAD_I64(p) _mm256_loadu_si256((__m256i const*)(p))
+#   define LOAD_F32(p) _mm256_loadu_ps(p)
+#   define LOAD_F64(p) _mm256_loadu_pd(p)
+#   define EQ_I32(x, y) _mm256_cmpeq_epi32(x, y)
+#   define LT_I32(x, y) _mm256_cmpgt_epi32(y, x)
+#   define LE_I32(x, y) \
+        _mm256_xor_si256(_mm256_cmpgt_epi32(x, y), _mm256_set1_epi32(-1))
+#   define EQ_I64(x, y) _mm256_cmpeq_epi64(x, y)
+#   define LT_I64(x, y) _mm256_cmpgt_epi64(y, x)
+#   define LE_I64(x, y) \
+        _mm256_xor_si256(_mm256_cmpgt_epi64(x, y), _mm256_set1_epi64x(-1))
+#   define EQ_F32(x, y) _mm256_cmp_ps(x, y, _CMP_EQ_OQ)
+#   define LT_F32(x, y) _mm256_cmp_ps(x, y, _CMP_LT_OQ)
+#   define LE_F32(x, y) _mm256_cmp_ps(x, y, _CMP_LE_OQ)
+#   define EQ_F64(x, y) _mm256_cmp_pd(x, y, _CMP_EQ_OQ)
+#   define LT_F64(x, y) _mm256_cmp_pd(x, y, _CMP_LT_OQ)
+#   define LE_F64(x, y) _mm256_cmp_pd(x, y, _CMP_LE_OQ)
+#   define MOVEMASK_I32(m) _mm256_movemask_ps(_mm256_castsi256_ps(m))
+#   define MOVEMASK_I64(m) _mm256_movemask_pd(_mm256_castsi256_pd(m))
+#   define MOVEMASK_F32(m) _mm256_movemask_ps(m)
+#   define MOVEMASK_F64(m) _mm256_movemask_pd(m)
+#   define LANES_32 8
+#   define LANES_64 4
+#else
+#   define LOAD_SCALAR(p) (*(p))
+#   define LOAD_I32 LOAD_SCALAR
+#   define LOAD_I64 LOAD_SCALAR
+#   define LOAD_F32 LOAD_SCALAR
+#   define LOAD_F64 LOAD_SCALAR
+#   define EQ_SCALAR(x, y) ((x) == (y))
+#   define LT_SCALAR(x, y) ((x) < (y))
+#   define LE_SCALAR(x, y) ((x) <= (y))
+#   define EQ_I32 EQ_SCALAR
+#   define LT_I32 LT_SCALAR
+#   define LE_I32 LE_SCALAR
+#   define EQ_I64 EQ_SCALAR
+#   define LT_I64 LT_SCALAR
+#   define LE_I64 LE_SCALAR
+#   define EQ_F32 EQ_SCALAR
+#   define LT_F32 LT_SCALAR
+#   define LE_F32 LE_SCALAR
+#   define EQ_F64 EQ_SCALAR
+#   define LT_F64 LT_SCALAR
+#   define LE_F64 LE_SCALAR
+#   define MOVEMASK_SCALAR(m) (m)
+#   define MOVEMASK_I32 MOVEMASK_SCALAR
+#   define MOVEMASK_I64 MOVEMASK_SCALAR
+#   define MOVEMASK_F32 MOVEMASK_SCALAR
+#   define MOVEMASK_F64 MOVEMASK_SCALAR
+#   define LANES_32 1
+#   define LANES_64 1
+#endif
+
+// Evaluated like a BitArrayCompare: checks whether operands[0] belongs to the
+// interval [ operands[1], operands[2] ].
+#define PREDICATE_BETWEEN (BIT_ARRAY_GE + 1)
+
+// Defines the predicate kernels over columns of type, whose element
+// comparisons are EQ_##suffix, LT_##suffix and LE_##suffix.
+#define DEFINE_PREDICATES(name, type, suffix, lanes)                         \
+    DEFINE_MASK64(eq64_##name, type, lanes, LOAD_##suffix, EQ_##suffix,      \
+        MOVEMASK_##suffix)                                                   \
+    DEFINE_MASK64(lt64_##name, type, lanes, LOAD_##suffix, LT_##suffix,      \
+        MOVEMASK_##suffix)                                                   \
+    DEFINE_MASK64(le64_##name, type, lanes, LOAD_##suffix, LE_##suffix,      \
+        MOVEMASK_##suffix)                                                   \
+                                                                             \
+    static uint64_t evaluate64_##name(                                       \
+        type const* const* const operands,                                   \
+        int const predicate                                                  \
+    ) {                                                                      \
+        type const* const lhs = operands[0];                                 \
+        type const* const rhs = operands[1];                                 \
+                                                                             \
+        switch (predicate) {                                                 \
+        case BIT_ARRAY_EQ:                                                   \
+            return eq64_##name(lhs, rhs);                                    \
+        case BIT_ARRAY_NE:                                                   \
+            return ~eq64_##name(lhs, rhs);                                   \
+        case BIT_ARRAY_LT:                                                   \
+            return lt64_##name(lhs, rhs);                                    \
+        case BIT_ARRAY_LE:                                                   \
+            return le64_##name(lhs, rhs);                                    \
+        case BIT_ARRAY_GT:                                                   \
+            return lt64_##name(rhs, lhs);                                    \
+        case BIT_ARRAY_GE:                                                   \
+            return le64_##name(rhs, lhs);                                    \
+        case PREDICATE_BETWEEN:                                              \
+            return le64_##name(rhs, lhs) & le64_##name(lhs, operands[2]);   \
+        }                                                                    \
+        return 0;                                                            \
+    }                                                                        \
+                                                                             \
+    /* Evaluates the predicate 64 elements at a time. operands[k] advances  \
+     * by steps[k] elements after each 64 elements, so that a step of zero  \
+     * repeats a buffer of 64 elements along the whole column. */           \
+    static void combine_predicate_##name(                                    \
+        BitArray* const ba,                                                  \
+        type const* const* const operands,                                   \
+        size_t const* const steps,                                           \
+        int const predicate,                                                 \
+        BitArrayCombine const combine                                        \
+    ) {                                                                      \
+        size_t const whole_chunks = ba->length_in_bits / 64;                 \
+        size_t const remaining = ba->length_in_bits % 64;                    \
+        type const* chunk[3] = { operands[0], operands[1], operands[2] };   \
+                                                                             \
+        if (ba->flags) {                                                     \
+            bitarray_bytes_will_change(ba, 0,                                \
+                bitarray_capacity_in_bytes(ba));                             \
+        }                                                                    \
+                                                                             \
+        for (size_t c = 0; c != whole_chunks; ++c) {                         \
+            uint64_t const mask = evaluate64_##name(chunk, predicate);       \
+            combine_word(ba->data + c * 8, mask, combine);                   \
+            for (size_t k = 0; k != 3; ++k) {                                \
+                chunk[k] += steps[k];                                        \
+            }                                                                \
+        }                                                                    \
+                                                                             \
+        if (remaining) {                                                     \
+            /* Copies the last elements to buffers that can be read whole. */\
+            type tails[3][64] = { { 0 } };                                   \
+            type const* tail_chunk[3];                                       \
+            for (size_t k = 0; k != 3; ++k) {                                \
+                if (chunk[k]) {                                              \
+                    memcpy(tails[k], chunk[k], remaining * sizeof(type));    \
+                }                                                            \
+                tail_chunk[k] = tails[k];                                    \
+            }                                                                \
+            uint64_t const mask = evaluate64_##name(tail_chunk, predicate)  \
+                & ((UINT64_C(1) << remaining) - 1);                          \
+            combine_word(ba->data + whole_chunks * 8, mask, combine);        \
+        }                                                                    \
+                                                                             \
+        if (ba->flags) {                                                     \
+            bitarray_bytes_did_change(ba, 0,                                 \
+                bitarray_capacity_in_bytes(ba));                             \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    void bitarray_compare_##name(                                            \
+        BitArray* const ba,                                                  \
+        type const* const column,                                            \
+        BitArrayCompare const compare,                                       \
+        type const value,                                                    \
+        BitArrayCombine const combine                                        \
+    ) {                                                                      \
+        type repeated[64];                                                   \
+        for (size_t j = 0; j != 64; ++j) {                                   \
+            repeated[j] = value;                                             \
+        }                                                                    \
+                                                                             \
+        type const* const operands[3] = { column, repeated, NULL };          \
+        size_t const steps[3] = { 64, 0, 0 };                                \
+        combine_predicate_##name(ba, operands, steps, compare, combine);     \
+    }                                                                        \
+                                                                             \
+    void bitarray_compare_##name##_columns(                                  \
+        BitArray* const ba,                                                  \
+        type const* const lhs,                                               \
+        BitArrayCompare const compare,                                       \
+        type const* const rhs,                                               \
+        BitArrayCombine const combine                                        \
+    ) {                                                                      \
+        type const* const operands[3] = { lhs, rhs, NULL };                  \
+        size_t const steps[3] = { 64, 64, 0 };                               \
+        combine_predicate_##name(ba, operands, steps, compare, combine);     \
+    }                                                                        \
+                                                                             \
+    void bitarray_between_##name(                                            \
+        BitArray* const ba,                                                  \
+        type const* const column,                                            \
+        type const low,                                                      \
+        type const high,                                                     \
+        BitArrayCombine const combine                                        \
+    ) {                                                                      \
+        type lows[64];                                                       \
+        type highs[64];                                                      \
+        for (size_t j = 0; j != 64; ++j) {                                   \
+            lows[j] = low;                                                   \
+            highs[j] = high;                                                 \
+        }                                                                    \
+                                                                             \
+        type const* const operands[3] = { column, lows, highs };             \
+        size_t const steps[3] = { 64, 0, 0 };                                \
+        combine_predicate_##name(                                            \
+            ba, operands, steps, PREDICATE_BETWEEN, combine);                \
+    }
+
+DEFINE_PREDICATES(i32, int32_t, I32, LANES_32)
+DEFINE_PREDICATES(i64, int64_t, I64, LANES_64)
+DEFINE_PREDICATES(f32, float, F32, LANES_32)
+DEFINE_PREDICATES(f64, double, F64, LANES_64)
+
+#if BIT_ARRAY_USE_SIMD && defined(__AVX2__) && !defined(__AVX512F__)
+// compact_table32[mask] holds, in ascending bytes, the indices of the set bits
+// of the 8-bit mask: the lanes a permutation gathers to compact 8 elements of
+// 4 bytes.
+static uint64_t const compact_table32[256] = {
+    0x0000000000000000, 0x0000000000000000, 0x0000000000000001,
+    0x0000000000000100, 0x0000000000000002, 0x0000000000000200,
+    0x0000000000000201, 0x0000000000020100, 0x0000000000000003,
+    0x0000000000000300, 0x0000000000000301, 0x0000000000030100,
+    0x0000000000000302, 0x0000000000030200, 0x0000000000030201,
+    0x0000000003020100, 0x0000000000000004, 0x0000000000000400,
+    0x0000000000000401, 0x0000000000040100, 0x0000000000000402,
+    0x0000000000040200, 0x0000000000040201, 0x0000000004020100,
+    0x0000000000000403, 0x0000000000040300, 0x0000000000040301,
+    0x0000000004030100, 0x0000000000040302, 0x0000000004030200,
+    0x0000000004030201, 0x0000000403020100, 0x0000000000000005,
+    0x0000000000000500, 0x0000000000000501, 0x0000000000050100,
+    0x0000000000000502, 0x0000000000050200, 0x0000000000050201,
+    0x0000000005020100, 0x0000000000000503, 0x0000000000050300,
+    0x0000000000050301, 0x0000000005030100, 0x0000000000050302,
+    0x0000000005030200, 0x0000000005030201, 0x0000000503020100,
+    0x0000000000000504, 0x0000000000050400, 0x0000000000050401,
+    0x0000000005040100, 0x0000000000050402, 0x0000000005040200,
+    0x0000000005040201, 0x0000000504020100, 0x0000000000050403,
+    0x0000000005040300, 0x0000000005040301, 0x0000000504030100,
+    0x0000000005040302, 0x0000000504030200, 0x0000000504030201,
+    0x0000050403020100, 0x0000000000000006, 0x0000000000000600,
+    0x0000000000000601, 0x0000000000060100, 0x0000000000000602,
+    0x0000000000060200, 0x0000000000060201, 0x0000000006020100,
+    0x0000000000000603, 0x0000000000060300, 0x0000000000060301,
+    0x0000000006030100, 0x0000000000060302, 0x0000000006030200,
+    0x0000000006030201, 0x0000000603020100, 0x0000000000000604,
+    0x0000000000060400, 0x0000000000060401, 0x0000000006040100,
+    0x0000000000060402, 0x0000000006040200, 0x0000000006040201,
+    0x0000000604020100, 0x0000000000060403, 0x0000000006040300,
+    0x0000000006040301, 0x0000000604030100, 0x0000000006040302,
+    0x0000000604030200, 0x0000000604030201, 0x0000060403020100,
+    0x0000000000000605, 0x0000000000060500, 0x0000000000060501,
+    0x0000000006050100, 0x0000000000060502, 0x0000000006050200,
+    0x0000000006050201, 0x0000000605020100, 0x0000000000060503,
+    0x0000000006050300, 0x0000000006050301, 0x0000000605030100,
+    0x0000000006050302, 0x0000000605030200, 0x0000000605030201,
+    0x0000060503020100, 0x0000000000060504, 0x0000000006050400,
+    0x0000000006050401, 0x0000000605040100, 0x0000000006050402,
+    0x0000000605040200, 0x0000000605040201, 0x0000060504020100,
+    0x0000000006050403, 0x0000000605040300, 0x0000000605040301,
+    0x0000060504030100, 0x0000000605040302, 0x0000060504030200,
+    0x0000060504030201, 0x0006050403020100, 0x0000000000000007,
+    0x0000000000000700, 0x0000000000000701, 0x0000000000070100,
+    0x0000000000000702, 0x0000000000070200, 0x0000000000070201,
+    0x0000000007020100, 0x0000000000000703, 0x0000000000070300,
+    0x0000000000070301, 0x0000000007030100, 0x0000000000070302,
+    0x0000000007030200, 0x0000000007030201, 0x0000000703020100,
+    0x0000000000000704, 0x0000000000070400, 0x0000000000070401,
+    0x0000000007040100, 0x0000000000070402, 0x0000000007040200,
+    0x0000000007040201, 0x0000000704020100, 0x0000000000070403,
+    0x0000000007040300, 0x0000000007040301, 0x0000000704030100,
+    0x0000000007040302, 0x0000000704030200, 0x0000000704030201,
+    0x0000070403020100, 0x0000000000000705, 0x0000000000070500,
+    0x0000000000070501, 0x0000000007050100, 0x0000000000070502,
+    0x0000000007050200, 0x0000000007050201, 0x0000000705020100,
+    0x0000000000070503, 0x0000000007050300, 0x0000000007050301,
+    0x0000000705030100, 0x0000000007050302, 0x0000000705030200,
+    0x0000000705030201, 0x0000070503020100, 0x0000000000070504,
+    0x0000000007050400, 0x0000000007050401, 0x0000000705040100,
+    0x0000000007050402, 0x0000000705040200, 0x0000000705040201,
+    0x0000070504020100, 0x0000000007050403, 0x0000000705040300,
+    0x0000000705040301, 0x0000070504030100, 0x0000000705040302,
+    0x0000070504030200, 0x0000070504030201, 0x0007050403020100,
+    0x0000000000000706, 0x0000000000070600, 0x0000000000070601,
+    0x0000000007060100, 0x0000000000070602, 0x0000000007060200,
+    0x0000000007060201, 0x0000000706020100, 0x0000000000070603,
+    0x0000000007060300, 0x0000000007060301, 0x0000000706030100,
+    0x0000000007060302, 0x0000000706030200, 0x0000000706030201,
+    0x0000070603020100, 0x0000000000070604, 0x0000000007060400,
+    0x0000000007060401, 0x0000000706040100, 0x0000000007060402,
+    0x0000000706040200, 0x0000000706040201, 0x0000070604020100,
+    0x0000000007060403, 0x0000000706040300, 0x0000000706040301,
+    0x0000070604030100, 0x0000000706040302, 0x0000070604030200,
+    0x0000070604030201, 0x0007060403020100, 0x0000000000070605,
+    0x0000000007060500, 0x0000000007060501, 0x0000000706050100,
+    0x0000000007060502, 0x0000000706050200, 0x0000000706050201,
+    0x0000070605020100, 0x0000000007060503, 0x0000000706050300,
+    0x0000000706050301, 0x0000070605030100, 0x0000000706050302,
+    0x0000070605030200, 0x0000070605030201, 0x0007060503020100,
+    0x0000000007060504, 0x0000000706050400, 0x0000000706050401,
+    0x0000070605040100, 0x0000000706050402, 0x0000070605040200,
+    0x0000070605040201, 0x0007060504020100, 0x0000000706050403,
+    0x0000070605040300, 0x0000070605040301, 0x0007060504030100,
+    0x0000070605040302, 0x0007060504030200, 0x0007060504030201,
+    0x0706050403020100,
+};
+
+// compact_table64[mask] holds, in ascending bytes, the pairs of 4-byte lanes
+// of the elements selected by the 4-bit mask: the lanes a permutation gathers
+// to compact 4 elements of 8 bytes.
+static uint64_t const compact_table64[16] = {
+    0x0000000000000000, 0x0000000000000100, 0x0000000000000302,
+    0x0000000003020100, 0x0000000000000504, 0x0000000005040100,
+    0x0000000005040302, 0x0000050403020100, 0x0000000000000706,
+    0x0000000007060100, 0x0000000007060302, 0x0000070603020100,
+    0x0000000007060504, 0x0000070605040100, 0x0000070605040302,
+    0x0706050403020100,
+};
+#endif
+
+// Copies to dst, in order, the elements of src whose bit is set in word.
+// Returns the number of elements copied.
+static inline size_t compact_word(
+    uint64_t word,
+    uint8_t const* const src,
+    uint8_t* const dst,
+    size_t const element_size
+) {
+    size_t copied = 0;
+
+    for (; word; word &= word - 1) {
+        memcpy(
+            dst + copied * element_size,
+            src + word_lowest_set(word) * element_size,
+            element_size
+        );
+        ++copied;
+    }
+
+    return copied;
+}
+
+// Copies to dst, in order, the 4-byte elements of src whose index i belongs to
+// [first, last) and whose bit at index i of bits is set. first must be a
+// multiple of 64. Returns the number of elements copied.
+static size_t compact32(
+    uint8_t const* const bits,
+    size_t const first,
+    size_t const last,
+    uint8_t const* const src,
+    uint8_t* const dst
+) {
+    size_t copied = 0;
+    size_t i = first;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX2__) && !defined(__AVX512F__)
+    __m256i const lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+#   endif
+
+    for (; i + 64 <= last; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 16) {
+            __mmask16 const mask = (__mmask16)(word >> group);
+            unsigned const count = word_popcount(mask);
+            __m512i const elements =
+                _mm512_loadu_si512(src + (i + group) * 4);
+            _mm512_mask_storeu_epi32(
+                dst + copied * 4,
+                (__mmask16)((1u << count) - 1),
+                _mm512_maskz_compress_epi32(mask, elements)
+            );
+            copied += count;
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 8) {
+            unsigned const mask = (unsigned)(word >> group) & 0xFFu;
+            unsigned const count = word_popcount(mask);
+            __m256i const permutation = _mm256_cvtepu8_epi32(
+                _mm_cvtsi64_si128((long long)compact_table32[mask])
+            );
+            __m256i const elements = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256((__m256i const*)(src + (i + group) * 4)),
+                permutation
+            );
+            _mm256_maskstore_epi32(
+                (int*)(dst + copied * 4),
+                _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lanes),
+                elements
+            );
+            copied += count;
+        }
+#       else
+        copied += compact_word(word, src + i * 4, dst + copied * 4, 4);
+#       endif
+    }
+
+    if (i < last) {
+        uint64_t const word = load_word(bits + i / 8)
+            & ((UINT64_C(1) << (last - i)) - 1);
+        copied += compact_word(word, src + i * 4, dst + copied * 4, 4);
+    }
+
+    return copied;
+}
+
+// Copies to dst, in order, the 8-byte elements of src whose index i belongs to
+// [first, last) and whose bit at index i of bits is set. first must be a
+// multiple of 64. Returns the number of elements copied.
+static size_t compact64(
+    uint8_t const* const bits,
+    size_t const first,
+    size_t const last,
+    uint8_t const* const src,
+    uint8_t* const dst
+) {
+    size_t copied = 0;
+    size_t i = first;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX2__) && !defined(__AVX512F__)
+    __m256i const lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+#   endif
+
+    for (; i + 64 <= last; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 8) {
+            __mmask8 const mask = (__mmask8)(word >> group);
+            unsigned const count = word_popcount(mask);
+            __m512i const elements =
+                _mm512_loadu_si512(src + (i + group) * 8);
+            _mm512_mask_storeu_epi64(
+                dst + copied * 8,
+                (__mmask8)((1u << count) - 1),
+                _mm512_maskz_compress_epi64(mask, elements)
+            );
+            copied += count;
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 4) {
+            unsigned const mask = (unsigned)(word >> group) & 0x0Fu;
+            unsigned const count = word_popcount(mask);
+            __m256i const permutation = _mm256_cvtepu8_epi32(
+                _mm_cvtsi64_si128((long long)compact_table64[mask])
+            );
+            __m256i const elements = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256((__m256i const*)(src + (i + group) * 8)),
+                permutation
+            );
+            _mm256_maskstore_epi64(
+                (long long*)(dst + copied * 8),
+                _mm256_cmpgt_epi64(_mm256_set1_epi64x(count), lanes),
+                elements
+            );
+            copied += count;
+        }
+#       else
+        copied += compact_word(word, src + i * 8, dst + copied * 8, 8);
+#       endif
+    }
+
+    if (i < last) {
+        uint64_t const word = load_word(bits + i / 8)
+            & ((UINT64_C(1) << (last - i)) - 1);
+        copied += compact_word(word, src + i * 8, dst + copied * 8, 8);
+    }
+
+    return copied;
+}
+
+// Compacts the elements of element_size bytes, either 4 or 8, whose index
+// belongs to [first, last). first must be a multiple of 64.
+static size_t compact_rows(
+    uint8_t const* const bits,
+    size_t const first,
+    size_t const last,
+    void const* const src,
+    void* const dst,
+    size_t const element_size
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(element_size == 4 || element_size == 8);
+#   endif
+
+    if (element_size == 4) {
+        return compact32(bits, first, last, src, dst);
+    }
+
+    return compact64(bits, first, last, src, dst);
+}
+
+size_t bitarray_compact_u32(
+    BitArray const* const ba,
+    uint32_t const* const src,
+    uint32_t* const dst
+) {
+    return compact32(ba->data, 0, ba->length_in_bits,
+        (uint8_t const*)src, (uint8_t*)dst);
+}
+
+size_t bitarray_compact_u64(
+    BitArray const* const ba,
+    uint64_t const* const src,
+    uint64_t* const dst
+) {
+    return compact64(ba->data, 0, ba->length_in_bits,
+        (uint8_t const*)src, (uint8_t*)dst);
+}
+
+size_t bitarray_compact_f32(
+    BitArray const* const ba,
+    float const* const src,
+    float* const dst
+) {
+    return compact32(ba->data, 0, ba->length_in_bits,
+        (uint8_t const*)src, (uint8_t*)dst);
+}
+
+size_t bitarray_compact_f64(
+    BitArray const* const ba,
+    double const* const src,
+    double* const dst
+) {
+    return compact64(ba->data, 0, ba->length_in_bits,
+        (uint8_t const*)src, (uint8_t*)dst);
+}
+
+size_t bitarray_compact_columns(
+    BitArray const* const ba,
+    BitArrayColumn const* const columns,
+    size_t const column_count
+) {
+    // Rows are compacted a block at a time for every column, so that the bits
+    // of the block stay in the cache.
+    size_t const block_rows = 4096;
+    size_t copied = 0;
+
+    for (size_t first = 0; first < ba->length_in_bits; first += block_rows) {
+        size_t const last = ba->length_in_bits - first < block_rows
+            ? ba->length_in_bits
+            : first + block_rows;
+        size_t block_copied = 0;
+
+        for (size_t c = 0; c != column_count; ++c) {
+            size_t const element_size = columns[c].element_size;
+            block_copied = compact_rows(
+                ba->data,
+                first,
+                last,
+                columns[c].src,
+                (uint8_t*)columns[c].dst + copied * element_size,
+                element_size
+            );
+        }
+
+        copied += block_copied;
+    }
+
+    return copied;
+}
+
+#if BIT_ARRAY_USE_SIMD && defined(__AVX2__) && !defined(__AVX512F__)
+// expand_table32[mask] holds, in byte j, the number of set bits of the 8-bit
+// mask below bit j: the lane a permutation moves to lane j to expand 8
+// elements of 4 bytes.
+static uint64_t const expand_table32[256] = {
+    0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+    0x0000000000000100, 0x0000000000000000, 0x0000000000010000,
+    0x0000000000010000, 0x0000000000020100, 0x0000000000000000,
+    0x0000000001000000, 0x0000000001000000, 0x0000000002000100,
+    0x0000000001000000, 0x0000000002010000, 0x0000000002010000,
+    0x0000000003020100, 0x0000000000000000, 0x0000000100000000,
+    0x0000000100000000, 0x0000000200000100, 0x0000000100000000,
+    0x0000000200010000, 0x0000000200010000, 0x0000000300020100,
+    0x0000000100000000, 0x0000000201000000, 0x0000000201000000,
+    0x0000000302000100, 0x0000000201000000, 0x0000000302010000,
+    0x0000000302010000, 0x0000000403020100, 0x0000000000000000,
+    0x0000010000000000, 0x0000010000000000, 0x0000020000000100,
+    0x0000010000000000, 0x0000020000010000, 0x0000020000010000,
+    0x0000030000020100, 0x0000010000000000, 0x0000020001000000,
+    0x0000020001000000, 0x0000030002000100, 0x0000020001000000,
+    0x0000030002010000, 0x0000030002010000, 0x0000040003020100,
+    0x0000010000000000, 0x0000020100000000, 0x0000020100000000,
+    0x0000030200000100, 0x0000020100000000, 0x0000030200010000,
+    0x0000030200010000, 0x0000040300020100, 0x0000020100000000,
+    0x0000030201000000, 0x0000030201000000, 0x0000040302000100,
+    0x0000030201000000, 0x0000040302010000, 0x0000040302010000,
+    0x0000050403020100, 0x0000000000000000, 0x0001000000000000,
+    0x0001000000000000, 0x0002000000000100, 0x0001000000000000,
+    0x0002000000010000, 0x0002000000010000, 0x0003000000020100,
+    0x0001000000000000, 0x0002000001000000, 0x0002000001000000,
+    0x0003000002000100, 0x0002000001000000, 0x0003000002010000,
+    0x0003000002010000, 0x0004000003020100, 0x0001000000000000,
+    0x0002000100000000, 0x0002000100000000, 0x0003000200000100,
+    0x0002000100000000, 0x0003000200010000, 0x0003000200010000,
+    0x0004000300020100, 0x0002000100000000, 0x0003000201000000,
+    0x0003000201000000, 0x0004000302000100, 0x0003000201000000,
+    0x0004000302010000, 0x0004000302010000, 0x0005000403020100,
+    0x0001000000000000, 0x0002010000000000, 0x0002010000000000,
+    0x0003020000000100, 0x0002010000000000, 0x0003020000010000,
+    0x0003020000010000, 0x0004030000020100, 0x0002010000000000,
+    0x0003020001000000, 0x0003020001000000, 0x0004030002000100,
+    0x0003020001000000, 0x0004030002010000, 0x0004030002010000,
+    0x0005040003020100, 0x0002010000000000, 0x0003020100000000,
+    0x0003020100000000, 0x0004030200000100, 0x0003020100000000,
+    0x0004030200010000, 0x0004030200010000, 0x0005040300020100,
+    0x0003020100000000, 0x0004030201000000, 0x0004030201000000,
+    0x0005040302000100, 0x0004030201000000, 0x0005040302010000,
+    0x0005040302010000, 0x0006050403020100, 0x0000000000000000,
+    0x0100000000000000, 0x0100000000000000, 0x0200000000000100,
+    0x0100000000000000, 0x0200000000010000, 0x0200000000010000,
+    0x0300000000020100, 0x0100000000000000, 0x0200000001000000,
+    0x0200000001000000, 0x0300000002000100, 0x0200000001000000,
+    0x0300000002010000, 0x0300000002010000, 0x0400000003020100,
+    0x0100000000000000, 0x0200000100000000, 0x0200000100000000,
+    0x0300000200000100, 0x0200000100000000, 0x0300000200010000,
+    0x0300000200010000, 0x0400000300020100, 0x0200000100000000,
+    0x0300000201000000, 0x0300000201000000, 0x0400000302000100,
+    0x0300000201000000, 0x0400000302010000, 0x0400000302010000,
+    0x0500000403020100, 0x0100000000000000, 0x0200010000000000,
+    0x0200010000000000, 0x0300020000000100, 0x0200010000000000,
+    0x0300020000010000, 0x0300020000010000, 0x0400030000020100,
+    0x0200010000000000, 0x0300020001000000, 0x0300020001000000,
+    0x0400030002000100, 0x0300020001000000, 0x0400030002010000,
+    0x0400030002010000, 0x0500040003020100, 0x0200010000000000,
+    0x0300020100000000, 0x0300020100000000, 0x0400030200000100,
+    0x0300020100000000, 0x0400030200010000, 0x0400030200010000,
+    0x0500040300020100, 0x0300020100000000, 0x0400030201000000,
+    0x0400030201000000, 0x0500040302000100, 0x0400030201000000,
+    0x0500040302010000, 0x0500040302010000, 0x0600050403020100,
+    0x0100000000000000, 0x0201000000000000, 0x0201000000000000,
+    0x0302000000000100, 0x0201000000000000, 0x0302000000010000,
+    0x0302000000010000, 0x0403000000020100, 0x0201000000000000,
+    0x0302000001000000, 0x0302000001000000, 0x0403000002000100,
+    0x0302000001000000, 0x0403000002010000, 0x0403000002010000,
+    0x0504000003020100, 0x0201000000000000, 0x0302000100000000,
+    0x0302000100000000, 0x0403000200000100, 0x0302000100000000,
+    0x0403000200010000, 0x0403000200010000, 0x0504000300020100,
+    0x0302000100000000, 0x0403000201000000, 0x0403000201000000,
+    0x0504000302000100, 0x0403000201000000, 0x0504000302010000,
+    0x0504000302010000, 0x0605000403020100, 0x0201000000000000,
+    0x0302010000000000, 0x0302010000000000, 0x0403020000000100,
+    0x0302010000000000, 0x0403020000010000, 0x0403020000010000,
+    0x0504030000020100, 0x0302010000000000, 0x0403020001000000,
+    0x0403020001000000, 0x0504030002000100, 0x0403020001000000,
+    0x0504030002010000, 0x0504030002010000, 0x0605040003020100,
+    0x0302010000000000, 0x0403020100000000, 0x0403020100000000,
+    0x0504030200000100, 0x0403020100000000, 0x0504030200010000,
+    0x0504030200010000, 0x0605040300020100, 0x0403020100000000,
+    0x0504030201000000, 0x0504030201000000, 0x0605040302000100,
+    0x0504030201000000, 0x0605040302010000, 0x0605040302010000,
+    0x0706050403020100,
+};
+
+// expand_table64[mask] holds, in bytes 2j and 2j + 1, the pair of 4-byte lanes
+// a permutation moves to element j to expand 4 elements of 8 bytes by the
+// 4-bit mask.
+static uint64_t const expand_table64[16] = {
+    0x0000000000000000, 0x0000000000000100, 0x0000000001000000,
+    0x0000000003020100, 0x0000010000000000, 0x0000030200000100,
+    0x0000030201000000, 0x0000050403020100, 0x0100000000000000,
+    0x0302000000000100, 0x0302000001000000, 0x0504000003020100,
+    0x0302010000000000, 0x0504030200000100, 0x0504030201000000,
+    0x0706050403020100,
+};
+
+// Returns the lanes of 4 bytes whose bit is set in the 8-bit mask, with every
+// bit set.
+static inline __m256i lanes_selected32(unsigned const mask) {
+    __m256i const bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i const masks = _mm256_set1_epi32((int)mask);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(masks, bits), bits);
+}
+
+// Returns the lanes of 8 bytes whose bit is set in the 4-bit mask, with every
+// bit set.
+static inline __m256i lanes_selected64(unsigned const mask) {
+    __m256i const bits = _mm256_setr_epi64x(1, 2, 4, 8);
+    __m256i const masks = _mm256_set1_epi64x(mask);
+    return _mm256_cmpeq_epi64(_mm256_and_si256(masks, bits), bits);
+}
+#endif
+
+// Sets the count elements of dst to the element at fallback, then replaces
+// the ones whose bit is set in word by the elements of src, in order.
+// Returns the number of elements of src used.
+static inline size_t expand_word(
+    uint64_t word,
+    size_t const count,
+    uint8_t const* const src,
+    uint8_t const* const fallback,
+    uint8_t* const dst,
+    size_t const element_size
+) {
+    for (size_t j = 0; j != count; ++j) {
+        memcpy(dst + j * element_size, fallback, element_size);
+    }
+
+    size_t used = 0;
+
+    for (; word; word &= word - 1) {
+        memcpy(
+            dst + word_lowest_set(word) * element_size,
+            src + used * element_size,
+            element_size
+        );
+        ++used;
+    }
+
+    return used;
+}
+
+// Sets each of the count elements of dst to the element at the same index of
+// a if its bit is set in word, or of b otherwise.
+static inline void blend_word(
+    uint64_t const word,
+    size_t const count,
+    uint8_t const* const a,
+    uint8_t const* const b,
+    uint8_t* const dst,
+    size_t const element_size
+) {
+    for (size_t j = 0; j != count; ++j) {
+        uint8_t const* const chosen = ((word >> j) & 1) ? a : b;
+        memcpy(
+            dst + j * element_size,
+            chosen + j * element_size,
+            element_size
+        );
+    }
+}
+
+// Sets the element of dst at index i to the next unused element of src if the
+// bit at index i of bits is set, or to fallback otherwise, for every i in
+// [0, length), with elements of 4 bytes. Returns the number of elements of
+// src used.
+static size_t expand32(
+    uint8_t const* const bits,
+    size_t const length,
+    uint8_t const* const src,
+    uint32_t const fallback,
+    uint8_t* const dst
+) {
+    size_t used = 0;
+    size_t i = 0;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+    __m512i const fallbacks = _mm512_set1_epi32((int)fallback);
+#   elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+    __m256i const fallbacks = _mm256_set1_epi32((int)fallback);
+    __m256i const lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+#   endif
+
+    for (; i + 64 <= length; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 16) {
+            __mmask16 const mask = (__mmask16)(word >> group);
+            unsigned const count = word_popcount(mask);
+            // Only loads the elements used, which may end src.
+            __m512i const elements = _mm512_maskz_loadu_epi32(
+                (__mmask16)((1u << count) - 1),
+                src + used * 4
+            );
+            _mm512_storeu_si512(
+                dst + (i + group) * 4,
+                _mm512_mask_expand_epi32(fallbacks, mask, elements)
+            );
+            used += count;
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 8) {
+            unsigned const mask = (unsigned)(word >> group) & 0xFFu;
+            unsigned const count = word_popcount(mask);
+            // Only loads the elements used, which may end src.
+            __m256i const elements = _mm256_maskload_epi32(
+                (int const*)(src + used * 4),
+                _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), lanes)
+            );
+            __m256i const permutation = _mm256_cvtepu8_epi32(
+                _mm_cvtsi64_si128((long long)expand_table32[mask])
+            );
+            __m256i const expanded =
+                _mm256_permutevar8x32_epi32(elements, permutation);
+            _mm256_storeu_si256(
+                (__m256i*)(dst + (i + group) * 4),
+                _mm256_blendv_epi8(fallbacks, expanded, lanes_selected32(mask))
+            );
+            used += count;
+        }
+#       else
+        used += expand_word(word, 64, src + used * 4,
+            (uint8_t const*)&fallback, dst + i * 4, 4);
+#       endif
+    }
+
+    if (i < length) {
+        uint64_t const word = load_word(bits + i / 8);
+        used += expand_word(word, length - i, src + used * 4,
+            (uint8_t const*)&fallback, dst + i * 4, 4);
+    }
+
+    return used;
+}
+
+// Same as expand32, with elements of 8 bytes.
+static size_t expand64(
+    uint8_t const* const bits,
+    size_t const length,
+    uint8_t const* const src,
+    uint64_t const fallback,
+    uint8_t* const dst
+) {
+    size_t used = 0;
+    size_t i = 0;
+
+#   if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+    __m512i const fallbacks = _mm512_set1_epi64((long long)fallback);
+#   elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+    __m256i const fallbacks = _mm256_set1_epi64x((long long)fallback);
+    __m256i const lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+#   endif
+
+    for (; i + 64 <= length; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 8) {
+            __mmask8 const mask = (__mmask8)(word >> group);
+            unsigned const count = word_popcount(mask);
+            // Only loads the elements used, which may end src.
+            __m512i const elements = _mm512_maskz_loadu_epi64(
+                (__mmask8)((1u << count) - 1),
+                src + used * 8
+            );
+            _mm512_storeu_si512(
+                dst + (i + group) * 8,
+                _mm512_mask_expand_epi64(fallbacks, mask, elements)
+            );
+            used += count;
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 4) {
+            unsigned const mask = (unsigned)(word >> group) & 0x0Fu;
+            unsigned const count = word_popcount(mask);
+            // Only loads the elements used, which may end src.
+            __m256i const elements = _mm256_maskload_epi64(
+                (long long const*)(src + used * 8),
+                _mm256_cmpgt_epi64(_mm256_set1_epi64x(count), lanes)
+            );
+            __m256i const permutation = _mm256_cvtepu8_epi32(
+                _mm_cvtsi64_si128((long long)expand_table64[mask])
+            );
+            __m256i const expanded =
+                _mm256_permutevar8x32_epi32(elements, permutation);
+            _mm256_storeu_si256(
+                (__m256i*)(dst + (i + group) * 8),
+                _mm256_blendv_epi8(fallbacks, expanded, lanes_selected64(mask))
+            );
+            used += count;
+        }
+#       else
+        used += expand_word(word, 64, src + used * 8,
+            (uint8_t const*)&fallback, dst + i * 8, 8);
+#       endif
+    }
+
+    if (i < length) {
+        uint64_t const word = load_word(bits + i / 8);
+        used += expand_word(word, length - i, src + used * 8,
+            (uint8_t const*)&fallback, dst + i * 8, 8);
+    }
+
+    return used;
+}
+
+// Sets the element of dst at index i to the one of a if the bit at index i of
+// bits is set, or to the one of b otherwise, for every i in [0, length), with
+// elements of 4 bytes.
+static void blend32(
+    uint8_t const* const bits,
+    size_t const length,
+    uint8_t const* const a,
+    uint8_t const* const b,
+    uint8_t* const dst
+) {
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 16) {
+            size_t const offset = (i + group) * 4;
+            _mm512_storeu_si512(dst + offset, _mm512_mask_blend_epi32(
+                (__mmask16)(word >> group),
+                _mm512_loadu_si512(b + offset),
+                _mm512_loadu_si512(a + offset)
+            ));
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 8) {
+            size_t const offset = (i + group) * 4;
+            unsigned const mask = (unsigned)(word >> group) & 0xFFu;
+            _mm256_storeu_si256((__m256i*)(dst + offset), _mm256_blendv_epi8(
+                _mm256_loadu_si256((__m256i const*)(b + offset)),
+                _mm256_loadu_si256((__m256i const*)(a + offset)),
+                lanes_selected32(mask)
+            ));
+        }
+#       else
+        blend_word(word, 64, a + i * 4, b + i * 4, dst + i * 4, 4);
+#       endif
+    }
+
+    if (i < length) {
+        uint64_t const word = load_word(bits + i / 8);
+        blend_word(word, length - i, a + i * 4, b + i * 4, dst + i * 4, 4);
+    }
+}
+
+// Same as blend32, with elements of 8 bytes.
+static void blend64(
+    uint8_t const* const bits,
+    size_t const length,
+    uint8_t const* const a,
+    uint8_t const* const b,
+    uint8_t* const dst
+) {
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64) {
+        uint64_t const word = load_word(bits + i / 8);
+
+#       if BIT_ARRAY_USE_SIMD && defined(__AVX512F__)
+        for (size_t group = 0; group != 64; group += 8) {
+            size_t const offset = (i + group) * 8;
+            _mm512_storeu_si512(dst + offset, _mm512_mask_blend_epi64(
+                (__mmask8)(word >> group),
+                _mm512_loadu_si512(b + offset),
+                _mm512_loadu_si512(a + offset)
+            ));
+        }
+#       elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+        for (size_t group = 0; group != 64; group += 4) {
+            size_t const offset = (i + group) * 8;
+            unsigned const mask = (unsigned)(word >> group) & 0x0Fu;
+            _mm256_storeu_si256((__m256i*)(dst + offset), _mm256_blendv_epi8(
+                _mm256_loadu_si256((__m256i const*)(b + offset)),
+                _mm256_loadu_si256((__m256i const*)(a + offset)),
+                lanes_selected64(mask)
+            ));
+        }
+#       else
+        blend_word(word, 64, a + i * 8, b + i * 8, dst + i * 8, 8);
+#       endif
+    }
+
+    if (i < length) {
+        uint64_t const word = load_word(bits + i / 8);
+        blend_word(word, length - i, a + i * 8, b + i * 8, dst + i * 8, 8);
+    }
+}
+
+size_t bitarray_expand_u32(
+    BitArray const* const ba,
+    uint32_t const* const src,
+    uint32_t const fallback,
+    uint32_t* const dst
+) {
+    return expand32(ba->data, ba->length_in_bits,
+        (uint8_t const*)src, fallback, (uint8_t*)dst);
+}
+
+void bitarray_blend_u32(
+    BitArray const* const ba,
+    uint32_t const* const a,
+    uint32_t const* const b,
+    uint32_t* const dst
+) {
+    blend32(ba->data, ba->length_in_bits,
+        (uint8_t const*)a, (uint8_t const*)b, (uint8_t*)dst);
+}
+
+size_t bitarray_expand_u64(
+    BitArray const* const ba,
+    uint64_t const* const src,
+    uint64_t const fallback,
+    uint64_t* const dst
+) {
+    return expand64(ba->data, ba->length_in_bits,
+        (uint8_t const*)src, fallback, (uint8_t*)dst);
+}
+
+void bitarray_blend_u64(
+    BitArray const* const ba,
+    uint64_t const* const a,
+    uint64_t const* const b,
+    uint64_t* const dst
+) {
+    blend64(ba->data, ba->length_in_bits,
+        (uint8_t const*)a, (uint8_t const*)b, (uint8_t*)dst);
+}
+
+size_t bitarray_expand_f32(
+    BitArray const* const ba,
+    float const* const src,
+    float const fallback,
+    float* const dst
+) {
+    uint32_t fallback_bits;
+    memcpy(&fallback_bits, &fallback, sizeof(fallback_bits));
+
+    return expand32(ba->data, ba->length_in_bits,
+        (uint8_t const*)src, fallback_bits, (uint8_t*)dst);
+}
+
+void bitarray_blend_f32(
+    BitArray const* const ba,
+    float const* const a,
+    float const* const b,
+    float* const dst
+) {
+    blend32(ba->data, ba->length_in_bits,
+        (uint8_t const*)a, (uint8_t const*)b, (uint8_t*)dst);
+}
+
+size_t bitarray_expand_f64(
+    BitArray const* const ba,
+    double const* const src,
+    double const fallback,
+    double* const dst
+) {
+    uint64_t fallback_bits;
+    memcpy(&fallback_bits, &fallback, sizeof(fallback_bits));
+
+    return expand64(ba->data, ba->length_in_bits,
+        (uint8_t const*)src, fallback_bits, (uint8_t*)dst);
+}
+
+void bitarray_blend_f64(
+    BitArray const* const ba,
+    double const* const a,
+    double const* const b,
+    double* const dst
+) {
+    blend64(ba->data, ba->length_in_bits,
+        (uint8_t const*)a, (uint8_t const*)b, (uint8_t*)dst);
+}
@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+
+#include "bit_array.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pages are placed through the mbind system call and threads pinned through
+// their affinity, reading the nodes and their CPUs from sysfs, so that no
+// NUMA library is needed.
+#if defined(__linux__)
+#   define BIT_ARRAY_HAS_NUMA true
+#   include <linux/mempolicy.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <stdio.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#else
+#   define BIT_ARRAY_HAS_NUMA false
+#endif
+
+#if BIT_ARRAY_HAS_NUMA
+// Nodes are tracked in a single mask word, so only the first ones are used.
+#define NUMA_MAX_NODES 64
+
+// The online nodes of the host, read once.
+static struct NumaTopology {
+    unsigned node_count;
+    unsigned node_ids[NUMA_MAX_NODES];
+    cpu_set_t node_cpus[NUMA_MAX_NODES];
+} numa_topology;
+
+static pthread_once_t numa_topology_once = PTHREAD_ONCE_INIT;
+
+// Calls fn on every number of a sysfs list such as "0-3,8,10-11".
+// Returns false if the file cannot be read.
+static bool read_sysfs_list(
+    char const* const path,
+    void (*const fn)(unsigned number, void* ctx),
+    void* const ctx
+) {
+    FILE* const file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    unsigned first;
+    while (fscanf(file, "%u", &first) == 1) {
+        unsigned last = first;
+        int separator = fgetc(file);
+
+        if (separator == '-') {
+            if (fscanf(file, "%u", &last) != 1) {
+                break;
+            }
+            separator = fgetc(file);
+        }
+
+        for (unsigned number = first; number <= last; ++number) {
+            fn(number, ctx);
+        }
+
+        if (separator != ',') {
+            break;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void add_node(unsigned const node_id, void* const ctx) {
+    (void)ctx;
+    if (node_id < NUMA_MAX_NODES) {
+        numa_topology.node_ids[numa_topology.node_count++] = node_id;
+    }
+}
+
+static void add_cpu(unsigned const cpu, void* const ctx) {
+    if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, (cpu_set_t*)ctx);
+    }
+}
+
+static void numa_topology_read(void) {
+    read_sysfs_list("/sys/devices/system/node/online", add_node, NULL);
+
+    // Nodes without a CPU cannot run the threads of their chunks.
+    unsigned kept = 0;
+    for (unsigned node = 0; node != numa_topology.node_count; ++node) {
+        char path[64];
+        cpu_set_t* const cpus = numa_topology.node_cpus + kept;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+            numa_topology.node_ids[node]);
+        CPU_ZERO(cpus);
+        if (read_sysfs_list(path, add_cpu, cpus) && CPU_COUNT(cpus)) {
+            numa_topology.node_ids[kept++] = numa_topology.node_ids[node];
+        }
+    }
+    numa_topology.node_count = kept;
+}
+
+// Returns the number of online nodes with CPUs, zero if unknown.
+static unsigned numa_node_count(void) {
+    pthread_once(&numa_topology_once, numa_topology_read);
+    return numa_topology.node_count;
+}
+
+// Sets the memory policy of the pages of the interval [first, last), which
+// must start on a page boundary, to mode over the nodes of the mask.
+// Returns false if the system refuses it.
+static bool pages_bind(
+    uint8_t* const first,
+    uint8_t* const last,
+    int const mode,
+    unsigned long const mask
+) {
+    // The system reads one bit less than the number of bits it is given.
+    return first == last || !syscall(
+        SYS_mbind,
+        first,
+        (unsigned long)(last - first),
+        mode,
+        &mask,
+        (unsigned long)NUMA_MAX_NODES + 1,
+        0
+    );
+}
+#endif
+
+// Returns the number of pages of the mapping of a bitarray.
+static size_t mapping_in_pages(size_t const length, size_t const page_size) {
+    return (sizeof(BitArray) + storage_in_bytes(length) + page_size - 1)
+        / page_size;
+}
+
+// Returns the size of a page, which chunks start at.
+static size_t numa_page_size(void) {
+#   if BIT_ARRAY_HAS_NUMA
+    return (size_t)sysconf(_SC_PAGESIZE);
+#   else
+    return 4096;
+#   endif
+}
+
+// Returns the index of the page of the mapping of a bitarray where a chunk
+// starts. Chunk n starts at page n * pages / chunks.
+static size_t chunk_first_page(
+    BitArray const* const ba,
+    unsigned const chunk,
+    size_t const pages
+) {
+    return pages * chunk / ba->numa_nodes;
+}
+
+// Returns the index of the first word of a chunk, the first one starting in
+// its first page.
+static size_t chunk_first_word(BitArray const* const ba, unsigned const chunk) {
+    size_t const word_count = storage_in_bytes(ba->length_in_bits) / 8;
+
+    if (chunk >= bitarray_numa_chunks(ba)) {
+        return word_count;
+    }
+    if (!chunk) {
+        return 0;
+    }
+
+    size_t const page_size = numa_page_size();
+    size_t const pages = mapping_in_pages(ba->length_in_bits, page_size);
+    size_t const first_byte = chunk_first_page(ba, chunk, pages) * page_size;
+
+    if (first_byte <= sizeof(BitArray)) {
+        return 0;
+    }
+
+    size_t const first_word = (first_byte - sizeof(BitArray) + 7) / 8;
+    return first_word < word_count ? first_word : word_count;
+}
+
+unsigned bitarray_numa_chunks(BitArray const* const ba) {
+    return ba->numa_nodes > 1 ? ba->numa_nodes : 1;
+}
+
+void bitarray_numa_chunk(
+    BitArray const* const ba,
+    unsigned const chunk,
+    size_t* const first_bit,
+    size_t* const last_bit
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(chunk < bitarray_numa_chunks(ba));
+#   endif
+
+    size_t const first = 64 * chunk_first_word(ba, chunk);
+    size_t const last = 64 * chunk_first_word(ba, chunk + 1);
+
+    *first_bit = first < ba->length_in_bits ? first : ba->length_in_bits;
+    *last_bit = last < ba->length_in_bits ? last : ba->length_in_bits;
+}
+
+bool bitarray_bind_to_chunk(BitArray const* const ba, unsigned const chunk) {
+#   if BIT_ARRAY_ASSERTS
+    assert(chunk < bitarray_numa_chunks(ba));
+#   endif
+
+#   if BIT_ARRAY_HAS_NUMA
+    return ba->numa_nodes > 1 && !pthread_setaffinity_np(
+        pthread_self(),
+        sizeof(cpu_set_t),
+        numa_topology.node_cpus + chunk
+    );
+#   else
+    (void)ba;
+    (void)chunk;
+    return false;
+#   endif
+}
+
+unsigned bitarray_thread_chunk(
+    BitArray const* const ba,
+    unsigned const thread,
+    unsigned const threads
+) {
+    unsigned const chunks = bitarray_numa_chunks(ba);
+    return (unsigned)((uint64_t)thread * chunks / threads);
+}
+
+void bitarray_thread_words(
+    BitArray const* const ba,
+    unsigned const thread,
+    unsigned const threads,
+    size_t* const first_word,
+    size_t* const last_word
+) {
+    uint64_t const chunks = bitarray_numa_chunks(ba);
+
+    // Fewer threads than chunks: every thread takes whole chunks.
+    if (threads < chunks) {
+        *first_word = chunk_first_word(ba,
+            (unsigned)(chunks * thread / threads));
+        *last_word = chunk_first_word(ba,
+            (unsigned)(chunks * (thread + 1) / threads));
+        return;
+    }
+
+    // Otherwise, the threads of every chunk split it. The first thread of
+    // chunk c is the first one whose index maps to it.
+    unsigned const chunk = bitarray_thread_chunk(ba, thread, threads);
+    unsigned const first_thread =
+        (unsigned)((chunk * threads + chunks - 1) / chunks);
+    unsigned const last_thread =
+        (unsigned)(((chunk + 1) * threads + chunks - 1) / chunks);
+    size_t const first = chunk_first_word(ba, chunk);
+    size_t const words = chunk_first_word(ba, chunk + 1) - first;
+    unsigned const share = last_thread - first_thread;
+    unsigned const rank = thread - first_thread;
+
+    *first_word = first + words * rank / share;
+    *last_word = first + words * (rank + 1) / share;
+}
+
+// A call of bitarray_run_placed, wrapping the one of the caller.
+typedef struct PlacedRun {
+    BitArray const* ba;
+    void (*fn)(void* ctx, unsigned thread, unsigned threads);
+    void* ctx;
+} PlacedRun;
+
+static void placed_run_main(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    PlacedRun const* const run = ctx;
+
+#   if BIT_ARRAY_HAS_NUMA
+    cpu_set_t cpus;
+    bool const pinned = !pthread_getaffinity_np(
+        pthread_self(),
+        sizeof(cpu_set_t),
+        &cpus
+    ) && bitarray_bind_to_chunk(
+        run->ba,
+        bitarray_thread_chunk(run->ba, thread, threads)
+    );
+
+    run->fn(run->ctx, thread, threads);
+
+    if (pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+#   else
+    run->fn(run->ctx, thread, threads);
+#   endif
+}
+
+void bitarray_run_placed(
+    BitArray const* const ba,
+    unsigned const threads,
+    void (*const fn)(void* ctx, unsigned thread, unsigned threads),
+    void* const ctx
+) {
+    if (ba->numa_nodes <= 1) {
+        bitarray_run_parallel(threads, fn, ctx);
+        return;
+    }
+
+    PlacedRun run = { .ba = ba, .fn = fn, .ctx = ctx };
+    bitarray_run_parallel(threads, placed_run_main, &run);
+}
+
+#if BIT_ARRAY_HAS_NUMA
+// Zeroes the words of the thread, which allocates their untouched pages on
+// the node the thread is pinned to.
+static void first_touch_words(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    BitArray* const ba = ctx;
+    size_t first_word;
+    size_t last_word;
+
+    bitarray_thread_words(ba, thread, threads, &first_word, &last_word);
+    memset(ba->data + 8 * first_word, 0x00, 8 * (last_word - first_word));
+}
+
+// Places the pages of a mapped bitarray across the nodes by the policy.
+// Returns false, leaving the bitarray a single chunk, if the system refuses
+// it.
+static bool bitarray_place(
+    BitArray* const ba,
+    unsigned const nodes,
+    BitArrayNumaPolicy const policy
+) {
+    size_t const page_size = numa_page_size();
+    size_t const pages = mapping_in_pages(ba->length_in_bits, page_size);
+    uint8_t* const mapping = (uint8_t*)ba;
+
+    if (policy == BIT_ARRAY_NUMA_INTERLEAVED) {
+        unsigned long mask = 0;
+        for (unsigned node = 0; node != nodes; ++node) {
+            mask |= 1UL << numa_topology.node_ids[node];
+        }
+        return pages_bind(mapping, mapping + pages * page_size,
+            MPOL_INTERLEAVE, mask);
+    }
+
+    ba->numa_nodes = nodes;
+
+    // Preferring a node rather than binding to it lets a full node spill
+    // over to the others.
+    bool bound = policy == BIT_ARRAY_NUMA_PARTITIONED;
+    for (unsigned chunk = 0; bound && chunk != nodes; ++chunk) {
+        bound = pages_bind(
+            mapping + chunk_first_page(ba, chunk, pages) * page_size,
+            mapping + chunk_first_page(ba, chunk + 1, pages) * page_size,
+            MPOL_PREFERRED,
+            1UL << numa_topology.node_ids[chunk]
+        );
+    }
+
+    if (!bound) {
+        long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned const threads = cpus < (long)nodes ? nodes : (unsigned)cpus;
+        bitarray_run_placed(ba, threads, first_touch_words, ba);
+    }
+
+    return true;
+}
+#endif
+
+BitArray* bitarray_with_numa_policy(
+    size_t const length,
+    BitArrayNumaPolicy const policy
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+#   endif
+
+#   if BIT_ARRAY_HAS_NUMA
+    unsigned const nodes = numa_node_count();
+
+    if (nodes > 1) {
+        BitArray* const ba = bitarray_map(length);
+
+        if (ba) {
+            ba->length_in_bits = length;
+            if (bitarray_place(ba, nodes, policy)) {
+                return ba;
+            }
+            bitarray_delete(ba);
+        }
+    }
+#   else
+    (void)policy;
+#   endif
+
+    return bitarray_with_capacity(length);
+}
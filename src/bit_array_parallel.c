@@ -0,0 +1,276 @@
+#include "bit_array_internal.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Set bits are counted, and grouped into chunks, by blocks of this many
+// words.
+#define FOR_EACH_BLOCK_WORDS 512
+// Number of chunks per thread, so that threads done early take over the
+// chunks left by the others.
+#define FOR_EACH_CHUNKS_PER_THREAD 8
+
+// Arguments of a task run on its own thread.
+typedef struct ParallelTask {
+    void (*fn)(void* ctx, unsigned thread, unsigned threads);
+    void* ctx;
+    unsigned thread;
+    unsigned threads;
+    pthread_t handle;
+    bool started;
+} ParallelTask;
+
+static void* parallel_task_main(void* const arg) {
+    ParallelTask const* const task = arg;
+    task->fn(task->ctx, task->thread, task->threads);
+    return NULL;
+}
+
+void bitarray_run_parallel(
+    unsigned const threads,
+    void (*const fn)(void* ctx, unsigned thread, unsigned threads),
+    void* const ctx
+) {
+    if (threads <= 1) {
+        fn(ctx, 0, 1);
+        return;
+    }
+
+    ParallelTask* const tasks = malloc(threads * sizeof(ParallelTask));
+
+    // Without room for the tasks, runs them one after the other.
+    if (!tasks) {
+        for (unsigned thread = 0; thread != threads; ++thread) {
+            fn(ctx, thread, threads);
+        }
+        return;
+    }
+
+    for (unsigned thread = 1; thread != threads; ++thread) {
+        ParallelTask* const task = tasks + thread;
+        task->fn = fn;
+        task->ctx = ctx;
+        task->thread = thread;
+        task->threads = threads;
+        task->started = !pthread_create(
+            &task->handle,
+            NULL,
+            parallel_task_main,
+            task
+        );
+    }
+
+    fn(ctx, 0, threads);
+
+    // Tasks whose thread could not be created run on the calling thread.
+    for (unsigned thread = 1; thread != threads; ++thread) {
+        if (tasks[thread].started) {
+            pthread_join(tasks[thread].handle, NULL);
+        } else {
+            fn(ctx, thread, threads);
+        }
+    }
+
+    free(tasks);
+}
+
+// State shared by the threads of bitarray_parallel_for_each_set.
+typedef struct ForEachSet {
+    BitArray const* ba;
+    void (*fn)(size_t bit_idx, void* ctx);
+    void* ctx;
+    size_t word_count;
+    size_t block_count;
+    // Number of set bits in every block.
+    size_t* popcounts;
+    // Chunk i holds the blocks in the interval [bounds[i], bounds[i + 1]).
+    size_t* bounds;
+    size_t chunk_count;
+    // Number of NUMA chunks of the bitarray, whose blocks are cut into the
+    // chunks in the interval [node_chunks[n], node_chunks[n + 1]).
+    unsigned node_count;
+    size_t* node_chunks;
+    // Index of the next chunk of every NUMA chunk to be claimed.
+    atomic_size_t* next_chunks;
+} ForEachSet;
+
+// Returns the index of the first block starting at or after a word.
+static size_t first_block_of(size_t const first_word) {
+    return (first_word + FOR_EACH_BLOCK_WORDS - 1) / FOR_EACH_BLOCK_WORDS;
+}
+
+// Counts the set bits of the blocks of the thread.
+static void for_each_count(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    ForEachSet* const task = ctx;
+    size_t first_word;
+    size_t last_word;
+
+    bitarray_thread_words(task->ba, thread, threads, &first_word, &last_word);
+    size_t const first_block = first_block_of(first_word);
+    size_t const last_block = first_block_of(last_word);
+
+    for (size_t block = first_block; block != last_block; ++block) {
+        size_t const block_first = block * FOR_EACH_BLOCK_WORDS;
+        size_t const block_last =
+            task->word_count - block_first < FOR_EACH_BLOCK_WORDS
+            ? task->word_count
+            : block_first + FOR_EACH_BLOCK_WORDS;
+        size_t popcount = 0;
+
+        for (size_t word = block_first; word != block_last; ++word) {
+            popcount += word_popcount(bitarray_load_word(task->ba, word));
+        }
+        task->popcounts[block] = popcount;
+    }
+}
+
+// Claims the chunks of a NUMA chunk until none is left, calling fn on their
+// set bits.
+static void for_each_visit_node(ForEachSet* const task, unsigned const node) {
+    size_t const last_chunk = task->node_chunks[node + 1];
+
+    for (;;) {
+        size_t const chunk = atomic_fetch_add_explicit(
+            task->next_chunks + node,
+            1,
+            memory_order_relaxed
+        );
+        if (chunk >= last_chunk) {
+            return;
+        }
+
+        size_t const last_block = task->bounds[chunk + 1];
+        for (size_t block = task->bounds[chunk]; block != last_block; ++block) {
+            if (!task->popcounts[block]) {
+                continue;
+            }
+
+            size_t const first_word = block * FOR_EACH_BLOCK_WORDS;
+            size_t const last_word =
+                task->word_count - first_word < FOR_EACH_BLOCK_WORDS
+                ? task->word_count
+                : first_word + FOR_EACH_BLOCK_WORDS;
+            words_for_each_set(task->ba, first_word, last_word, task->fn,
+                task->ctx);
+        }
+    }
+}
+
+// Claims chunks until none is left, calling fn on their set bits. Takes the
+// chunks of the NUMA chunk of the thread first, then helps with the others.
+static void for_each_visit(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    ForEachSet* const task = ctx;
+    unsigned const home = bitarray_thread_chunk(task->ba, thread, threads);
+
+    for (unsigned n = 0; n != task->node_count; ++n) {
+        unsigned const node = (home + n) % task->node_count;
+        for_each_visit_node(task, node);
+    }
+}
+
+// Returns the index of the first block starting in a NUMA chunk.
+static size_t node_first_block(BitArray const* const ba, unsigned const node) {
+    size_t first_bit;
+    size_t last_bit;
+
+    bitarray_numa_chunk(ba, node, &first_bit, &last_bit);
+    return first_block_of((first_bit + 63) / 64);
+}
+
+void bitarray_parallel_for_each_set(
+    BitArray const* const ba,
+    void (*const fn)(size_t bit_idx, void* ctx),
+    void* const ctx,
+    unsigned const threads
+) {
+    size_t const word_count = storage_in_bytes(ba->length_in_bits) / 8;
+    size_t const block_count = 1 + (word_count - 1) / FOR_EACH_BLOCK_WORDS;
+    size_t const max_chunks = (size_t)threads * FOR_EACH_CHUNKS_PER_THREAD;
+
+    if (threads <= 1 || block_count == 1) {
+        bitarray_for_each_set(ba, fn, ctx);
+        return;
+    }
+
+    unsigned const node_count = bitarray_numa_chunks(ba);
+    ForEachSet task = {
+        .ba = ba,
+        .fn = fn,
+        .ctx = ctx,
+        .word_count = word_count,
+        .block_count = block_count,
+        .popcounts = malloc(block_count * sizeof(size_t)),
+        .bounds = malloc((max_chunks + node_count + 1) * sizeof(size_t)),
+        .node_count = node_count,
+        .node_chunks = malloc((node_count + 1) * sizeof(size_t)),
+        .next_chunks = malloc(node_count * sizeof(atomic_size_t)),
+    };
+
+    if (!task.popcounts || !task.bounds || !task.node_chunks
+        || !task.next_chunks
+    ) {
+        free(task.popcounts);
+        free(task.bounds);
+        free(task.node_chunks);
+        free(task.next_chunks);
+        bitarray_for_each_set(ba, fn, ctx);
+        return;
+    }
+
+    bitarray_run_placed(ba, threads, for_each_count, &task);
+
+    size_t total = 0;
+    for (size_t block = 0; block != block_count; ++block) {
+        total += task.popcounts[block];
+    }
+
+    // Cuts a chunk once it holds its share of the set bits, and where every
+    // NUMA chunk starts, so that no chunk straddles two nodes.
+    size_t const share = total / max_chunks + 1;
+    size_t held = 0;
+    unsigned node = 1;
+    task.bounds[0] = 0;
+    task.node_chunks[0] = 0;
+    for (size_t block = 0; block != block_count; ++block) {
+        for (; node != node_count && node_first_block(ba, node) <= block;
+            ++node
+        ) {
+            if (task.bounds[task.chunk_count] != block) {
+                task.bounds[++task.chunk_count] = block;
+                held = 0;
+            }
+            task.node_chunks[node] = task.chunk_count;
+        }
+
+        held += task.popcounts[block];
+        if (held >= share && task.chunk_count + 1 < max_chunks) {
+            task.bounds[++task.chunk_count] = block + 1;
+            held = 0;
+        }
+    }
+    if (task.bounds[task.chunk_count] != block_count) {
+        task.bounds[++task.chunk_count] = block_count;
+    }
+    for (; node != node_count + 1; ++node) {
+        task.node_chunks[node] = task.chunk_count;
+    }
+
+    for (node = 0; node != node_count; ++node) {
+        atomic_init(task.next_chunks + node, task.node_chunks[node]);
+    }
+    bitarray_run_placed(ba, threads, for_each_visit, &task);
+
+    free(task.popcounts);
+    free(task.bounds);
+    free(task.node_chunks);
+    free(task.next_chunks);
+}
@@ -0,0 +1,164 @@
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every pass splits the indices into at most this many buckets, by the next
+// bits of the index below the ones already split on.
+#define PARTITION_FANOUT_BITS 10
+#define PARTITION_FANOUT ((size_t)1 << PARTITION_FANOUT_BITS)
+// Buckets spanning at most this many bits, 4 MiB of the bitarray, are
+// applied right away, their bytes and pages staying in the caches and the TLB
+// meanwhile. Smaller buckets pay for more passes over the indices.
+#define PARTITION_REGION_BITS 25
+// Buckets with fewer indices are applied right away, whatever their span.
+#define PARTITION_MIN_COUNT 4096
+// Number of indices gathered per bucket before they are written out, a
+// cache line of them.
+#define PARTITION_LINE (64 / sizeof(size_t))
+
+// State shared by every pass of a partitioned update.
+typedef struct Partition {
+    BitArray* ba;
+    // A cache line per bucket, gathering its indices so that the buckets are
+    // written a whole line at a time.
+    size_t* lines;
+} Partition;
+
+// Sets the bits at the indices.
+static void indices_apply(
+    BitArray* const ba,
+    size_t const* const indices,
+    size_t const count
+) {
+    for (size_t i = 0; i != count; ++i) {
+        ba->data[indices[i] / 8] |= byte_set_at(indices[i] % 8);
+    }
+}
+
+// Sets the bits at the indices, which all belong in the interval
+// [base, base + 2^span_bits). Splits them into buckets written to dst, and
+// applies the buckets one at a time, splitting them again, from dst to
+// spare, while they span more than a region. The indices are only read
+// before the buckets are applied, so they become the spare of the next pass.
+// spare may be NULL if no bucket is split again.
+static void partition_apply(
+    Partition const* const partition,
+    size_t const* const indices,
+    size_t const count,
+    size_t* const dst,
+    size_t* const spare,
+    size_t const base,
+    unsigned const span_bits
+) {
+    if (span_bits <= PARTITION_REGION_BITS || count < PARTITION_MIN_COUNT) {
+        indices_apply(partition->ba, indices, count);
+        return;
+    }
+
+    unsigned const shift = span_bits - PARTITION_REGION_BITS
+        > PARTITION_FANOUT_BITS
+        ? span_bits - PARTITION_FANOUT_BITS
+        : PARTITION_REGION_BITS;
+    size_t const bucket_count = (size_t)1 << (span_bits - shift);
+    size_t offsets[PARTITION_FANOUT + 1];
+    uint8_t filled[PARTITION_FANOUT];
+
+    memset(offsets, 0x00, (bucket_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i != count; ++i) {
+        ++offsets[((indices[i] - base) >> shift) + 1];
+    }
+    for (size_t bucket = 0; bucket != bucket_count; ++bucket) {
+        offsets[bucket + 1] += offsets[bucket];
+    }
+
+    // Bucket b is written to dst from offsets[b] on, a line at a time.
+    memset(filled, 0x00, bucket_count);
+    for (size_t i = 0; i != count; ++i) {
+        size_t const bucket = (indices[i] - base) >> shift;
+        size_t* const line = partition->lines + bucket * PARTITION_LINE;
+
+        line[filled[bucket]] = indices[i];
+        if (++filled[bucket] == PARTITION_LINE) {
+            memcpy(dst + offsets[bucket], line,
+                PARTITION_LINE * sizeof(size_t));
+            offsets[bucket] += PARTITION_LINE;
+            filled[bucket] = 0;
+        }
+    }
+
+    // The partial line of every bucket follows its whole lines. They are all
+    // written out before the next pass reuses the lines.
+    for (size_t bucket = 0; bucket != bucket_count; ++bucket) {
+        memcpy(dst + offsets[bucket],
+            partition->lines + bucket * PARTITION_LINE,
+            filled[bucket] * sizeof(size_t));
+        offsets[bucket] += filled[bucket];
+    }
+
+    // Bucket b now ends at offsets[b].
+    size_t first = 0;
+    for (size_t bucket = 0; bucket != bucket_count; ++bucket) {
+        size_t const last = offsets[bucket];
+        partition_apply(partition, dst + first, last - first,
+            spare ? spare + first : NULL, dst + first, base + (bucket << shift),
+            shift);
+        first = last;
+    }
+}
+
+bool bitarray_set_partitioned(
+    BitArray* const ba,
+    size_t const* const indices,
+    size_t const count
+) {
+#   if BIT_ARRAY_ASSERTS
+    for (size_t i = 0; i != count; ++i) {
+        assert(indices[i] < ba->length_in_bits);
+    }
+#   endif
+
+    if (count < PARTITION_MIN_COUNT) {
+        return false;
+    }
+
+    // Sorted indices already update the bitarray from left to right.
+    bool sorted = true;
+    for (size_t i = 1; sorted && i != count; ++i) {
+        sorted = indices[i - 1] <= indices[i];
+    }
+    if (sorted) {
+        indices_apply(ba, indices, count);
+        return true;
+    }
+
+    unsigned const span_bits = ba->length_in_bits > 1
+        ? word_highest_set(ba->length_in_bits - 1) + 1
+        : 1;
+    // A second buffer is needed once the buckets of the first pass are split
+    // again.
+    bool const nested =
+        span_bits > PARTITION_REGION_BITS + PARTITION_FANOUT_BITS;
+    Partition const partition = {
+        .ba = ba,
+        .lines = aligned_alloc(64, PARTITION_FANOUT * 64),
+    };
+    size_t* const dst = malloc(count * sizeof(size_t));
+    size_t* const spare = nested ? malloc(count * sizeof(size_t)) : NULL;
+
+    if (!partition.lines || !dst || (nested && !spare)) {
+        free(partition.lines);
+        free(dst);
+        free(spare);
+        return false;
+    }
+
+    partition_apply(&partition, indices, count, dst, spare, 0, span_bits);
+
+    free(partition.lines);
+    free(dst);
+    free(spare);
+    return true;
+}
@@ -0,0 +1,275 @@
+#include "bit_builder.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Number of bits counted by a pair of directory words, as in rank_select.c.
+#define SUPERBLOCK_BITS 512
+// The storage grows by whole chunks of this many bits.
+#define CHUNK_BITS ((size_t)1 << 20)
+
+struct BitBuilder {
+    // Its length is the capacity of the bit builder.
+    BitArray* bits;
+    // Number of bits appended, including the pending ones.
+    size_t length;
+    // Bits appended since the last stored word, the first of them lowest.
+    uint64_t pending;
+    // Number of pending bits, in the interval [0, 64).
+    unsigned filled;
+    // The directory of the stored words, laid out as in rank_select.c, with
+    // room for every superblock of the capacity.
+    uint64_t* counts;
+    // Number of set bits in the stored words.
+    size_t ones;
+};
+
+// Returns the number of directory words needed by a capacity.
+static size_t counts_for(size_t const capacity) {
+    return 2 * (capacity / SUPERBLOCK_BITS + 1);
+}
+
+BitBuilder* bitbuilder_with_capacity(size_t const capacity) {
+#   if BIT_ARRAY_ASSERTS
+    assert(capacity);
+#   endif
+
+    BitBuilder* const bb = malloc(sizeof(BitBuilder));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bb);
+#   else
+    if (!bb) {
+        return NULL;
+    }
+#   endif
+
+    bb->bits = bitarray_with_capacity(capacity);
+    bb->counts = malloc(counts_for(capacity) * sizeof(uint64_t));
+    bb->length = 0;
+    bb->pending = 0;
+    bb->filled = 0;
+    bb->ones = 0;
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bb->bits && bb->counts);
+#   else
+    if (!bb->bits || !bb->counts) {
+        bitbuilder_delete(bb);
+        return NULL;
+    }
+#   endif
+
+    return bb;
+}
+
+void bitbuilder_delete(BitBuilder* const bb) {
+    if (bb) {
+        bitarray_delete(bb->bits);
+        free(bb->counts);
+    }
+    free(bb);
+}
+
+size_t bitbuilder_length(BitBuilder const* const bb) {
+    return bb->length;
+}
+
+// Grows the capacity of the bit builder to at least double, and to at least
+// the bits of the word starting at word_start, rounded up to whole chunks.
+// Returns false if an error occurs allocating memory.
+static bool bitbuilder_grow(BitBuilder* const bb, size_t const word_start) {
+    size_t const capacity = bb->bits->length_in_bits;
+    size_t wanted = capacity <= SIZE_MAX / 2 ? 2 * capacity : SIZE_MAX;
+
+    if (wanted < word_start + 64) {
+        wanted = word_start + 64;
+    }
+    if (wanted <= SIZE_MAX - CHUNK_BITS) {
+        wanted = (wanted + CHUNK_BITS - 1) / CHUNK_BITS * CHUNK_BITS;
+    }
+
+    // The directory grows first, so that it always covers the capacity.
+    uint64_t* const counts = realloc(
+        bb->counts,
+        counts_for(wanted) * sizeof(uint64_t)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(counts);
+#   else
+    if (!counts) {
+        return false;
+    }
+#   endif
+
+    bb->counts = counts;
+    BitArray* const bits = bitarray_resize(bb->bits, wanted);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bits);
+#   else
+    if (!bits) {
+        return false;
+    }
+#   endif
+
+    bb->bits = bits;
+    return true;
+}
+
+// Stores the word following the last stored one, at the word index, and
+// counts its set bits into the directory. Returns false if an error occurs
+// growing the storage.
+static bool bitbuilder_store(
+    BitBuilder* const bb,
+    size_t const word_idx,
+    uint64_t const word
+) {
+    if (64 * word_idx >= bb->bits->length_in_bits
+        && !bitbuilder_grow(bb, 64 * word_idx)
+    ) {
+        return false;
+    }
+
+    uint64_t* const counts = bb->counts + 2 * (word_idx / 8);
+    unsigned const j = word_idx % 8;
+
+    if (j) {
+        counts[1] |= (uint64_t)(bb->ones - counts[0]) << (9 * (j - 1));
+    } else {
+        counts[0] = bb->ones;
+        counts[1] = 0;
+    }
+
+    store_word(bb->bits->data + 8 * word_idx, word);
+    bb->ones += word_popcount(word);
+    return true;
+}
+
+bool bitbuilder_append(BitBuilder* const bb, bool const bit) {
+    return bitbuilder_append_bits(bb, bit, 1);
+}
+
+bool bitbuilder_append_bits(
+    BitBuilder* const bb,
+    uint64_t const value,
+    unsigned const width
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+#   endif
+
+    uint64_t const bits = value & low_bits_mask(width);
+    unsigned const filled = bb->filled;
+
+    if (filled + width < 64) {
+        bb->pending |= bits << filled;
+        bb->filled = filled + width;
+        bb->length += width;
+        return true;
+    }
+
+    // The pending word is complete.
+    if (!bitbuilder_store(bb, bb->length / 64, bb->pending | bits << filled)) {
+        return false;
+    }
+
+    bb->pending = filled ? bits >> (64 - filled) : 0;
+    bb->filled = filled + width - 64;
+    bb->length += width;
+    return true;
+}
+
+bool bitbuilder_append_run(
+    BitBuilder* const bb,
+    bool const bit,
+    size_t count
+) {
+    uint64_t const fill = bit ? UINT64_MAX : 0;
+
+    // Completes the pending word first.
+    if (bb->filled) {
+        unsigned const head = 64 - bb->filled;
+        if (count < head) {
+            return !count || bitbuilder_append_bits(bb, fill, (unsigned)count);
+        }
+        if (!bitbuilder_append_bits(bb, fill, head)) {
+            return false;
+        }
+        count -= head;
+    }
+
+    for (; count >= 64; count -= 64) {
+        if (!bitbuilder_store(bb, bb->length / 64, fill)) {
+            return false;
+        }
+        bb->length += 64;
+    }
+
+    return !count || bitbuilder_append_bits(bb, fill, (unsigned)count);
+}
+
+BitArray* bitbuilder_finish(BitBuilder* const bb, RankSelect** const rs) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bb->length);
+#   endif
+
+    size_t const length = bb->length;
+    *rs = NULL;
+
+    if (!length
+        || (bb->filled && !bitbuilder_store(bb, length / 64, bb->pending))
+    ) {
+        bitbuilder_delete(bb);
+        return NULL;
+    }
+
+    // Completes the last superblock, which may start at the end of the bits.
+    size_t const word_count = (length + 63) / 64;
+    size_t const last = length / SUPERBLOCK_BITS;
+    uint64_t* counts = bb->counts;
+
+    if (8 * last == word_count) {
+        counts[2 * last] = bb->ones;
+        counts[2 * last + 1] = 0;
+    } else {
+        uint64_t const within = bb->ones - counts[2 * last];
+        for (unsigned j = word_count % 8; j && j != 8; ++j) {
+            counts[2 * last + 1] |= within << (9 * (j - 1));
+        }
+    }
+
+    BitArray* const bits = bitarray_resize(bb->bits, length);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bits);
+#   else
+    if (!bits) {
+        bitbuilder_delete(bb);
+        return NULL;
+    }
+#   endif
+
+    // Gives back the directory past the last superblock, if it can move.
+    uint64_t* const trimmed = realloc(
+        counts,
+        counts_for(length) * sizeof(uint64_t)
+    );
+    if (trimmed) {
+        counts = trimmed;
+    }
+
+    size_t const ones = bb->ones;
+    free(bb);
+
+    *rs = rankselect_with_counts(bits, counts, ones);
+    if (!*rs) {
+        bitarray_delete(bits);
+        return NULL;
+    }
+
+    return bits;
+}
@@ -0,0 +1,358 @@
+#include "bit_stream.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct BitWriter {
+    // Its length is the capacity of the bit writer.
+    BitArray* bits;
+    // Number of bits written, including the pending ones.
+    size_t length;
+    // Bits written since the last stored word, the first of them lowest.
+    uint64_t pending;
+    // Number of pending bits, in the interval [0, 64).
+    unsigned filled;
+};
+
+struct BitReader {
+    uint8_t const* data;
+    size_t storage_bytes;
+    // Index of the next bit to read.
+    size_t position;
+    size_t last_bit;
+    // The next available bits, the next one lowest. The bits above them are
+    // unset.
+    uint64_t buffer;
+    unsigned available;
+};
+
+BitWriter* bitwriter_with_capacity(size_t const capacity) {
+#   if BIT_ARRAY_ASSERTS
+    assert(capacity);
+#   endif
+
+    BitWriter* const bw = malloc(sizeof(BitWriter));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bw);
+#   else
+    if (!bw) {
+        return NULL;
+    }
+#   endif
+
+    bw->bits = bitarray_with_capacity(capacity);
+    bw->length = 0;
+    bw->pending = 0;
+    bw->filled = 0;
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bw->bits);
+#   else
+    if (!bw->bits) {
+        free(bw);
+        return NULL;
+    }
+#   endif
+
+    return bw;
+}
+
+void bitwriter_delete(BitWriter* const bw) {
+    if (bw) {
+        bitarray_delete(bw->bits);
+    }
+    free(bw);
+}
+
+size_t bitwriter_length(BitWriter const* const bw) {
+    return bw->length;
+}
+
+// Grows the capacity of the bit writer to at least double, and to at least
+// the bits of the word starting at word_start. Returns false if an error
+// occurs allocating memory.
+static bool bitwriter_grow(BitWriter* const bw, size_t const word_start) {
+    size_t const capacity = bw->bits->length_in_bits;
+    size_t const doubled = capacity <= SIZE_MAX / 2 ? 2 * capacity : SIZE_MAX;
+    BitArray* const bits = bitarray_resize(
+        bw->bits,
+        doubled > word_start + 64 ? doubled : word_start + 64
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bits);
+#   else
+    if (!bits) {
+        return false;
+    }
+#   endif
+
+    bw->bits = bits;
+    return true;
+}
+
+bool bitwriter_write(
+    BitWriter* const bw,
+    uint64_t const value,
+    unsigned const width
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+#   endif
+
+    uint64_t const bits = value & low_bits_mask(width);
+    unsigned const filled = bw->filled;
+
+    if (filled + width < 64) {
+        bw->pending |= bits << filled;
+        bw->filled = filled + width;
+        bw->length += width;
+        return true;
+    }
+
+    // The pending word is complete.
+    size_t const word_start = bw->length - filled;
+    if (word_start >= bw->bits->length_in_bits
+        && !bitwriter_grow(bw, word_start)
+    ) {
+        return false;
+    }
+
+    store_word(bw->bits->data + word_start / 8, bw->pending | bits << filled);
+    bw->pending = filled ? bits >> (64 - filled) : 0;
+    bw->filled = filled + width - 64;
+    bw->length += width;
+    return true;
+}
+
+bool bitwriter_write_unary(BitWriter* const bw, uint64_t value) {
+    for (; value >= 64; value -= 64) {
+        if (!bitwriter_write(bw, 0, 64)) {
+            return false;
+        }
+    }
+
+    return bitwriter_write(bw, UINT64_C(1) << value, (unsigned)value + 1);
+}
+
+bool bitwriter_write_gamma(BitWriter* const bw, uint64_t const value) {
+#   if BIT_ARRAY_ASSERTS
+    assert(value);
+#   endif
+
+    unsigned const high = word_highest_set(value);
+
+    if (!high) {
+        return bitwriter_write(bw, 1, 1);
+    }
+
+    uint64_t const low = value & low_bits_mask(high);
+
+    // Most codes fit in a single write.
+    if (high < 32) {
+        return bitwriter_write(
+            bw,
+            UINT64_C(1) << high | low << (high + 1),
+            2 * high + 1
+        );
+    }
+
+    return bitwriter_write_unary(bw, high) && bitwriter_write(bw, low, high);
+}
+
+BitArray* bitwriter_finish(BitWriter* const bw) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bw->length);
+#   endif
+
+    BitArray* bits = bw->bits;
+    size_t const length = bw->length;
+
+    if (bw->filled) {
+        size_t const word_start = length - bw->filled;
+        if (word_start >= bits->length_in_bits
+            && !bitwriter_grow(bw, word_start)
+        ) {
+            bitwriter_delete(bw);
+            return NULL;
+        }
+        bits = bw->bits;
+        store_word(bits->data + word_start / 8, bw->pending);
+    }
+
+    free(bw);
+
+    if (!length) {
+        bitarray_delete(bits);
+        return NULL;
+    }
+
+    BitArray* const trimmed = bitarray_resize(bits, length);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(trimmed);
+#   else
+    if (!trimmed) {
+        bitarray_delete(bits);
+    }
+#   endif
+
+    return trimmed;
+}
+
+BitReader* bitreader_with_range(
+    BitArray const* const ba,
+    size_t const first_bit,
+    size_t const last_bit
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(first_bit <= last_bit && last_bit <= ba->length_in_bits);
+#   endif
+
+    BitReader* const br = malloc(sizeof(BitReader));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(br);
+#   else
+    if (!br) {
+        return NULL;
+    }
+#   endif
+
+    br->data = ba->data;
+    br->storage_bytes = storage_in_bytes(ba->length_in_bits);
+    br->position = first_bit;
+    br->last_bit = last_bit;
+    br->buffer = 0;
+    br->available = 0;
+    return br;
+}
+
+void bitreader_delete(BitReader* const br) {
+    free(br);
+}
+
+size_t bitreader_position(BitReader const* const br) {
+    return br->position;
+}
+
+size_t bitreader_remaining(BitReader const* const br) {
+    return br->last_bit - br->position;
+}
+
+// Reloads the buffer from the next bit with a single word load, which makes
+// at least 57 bits available unless fewer are left.
+static void bitreader_refill(BitReader* const br) {
+    size_t const position = br->position;
+    size_t const remaining = br->last_bit - position;
+
+    if (!remaining) {
+        br->buffer = 0;
+        br->available = 0;
+        return;
+    }
+
+    if (position / 8 + 8 <= br->storage_bytes) {
+        br->buffer = load_word(br->data + position / 8) >> (position % 8);
+        br->available = 64 - position % 8;
+    } else {
+        // Near the end of the storage, the aligned word is still in it.
+        br->buffer =
+            load_word(br->data + position / 64 * 8) >> (position % 64);
+        br->available = 64 - position % 64;
+    }
+
+    if (br->available > remaining) {
+        br->available = (unsigned)remaining;
+        br->buffer &= low_bits_mask((unsigned)remaining);
+    }
+}
+
+uint64_t bitreader_peek(BitReader* const br, unsigned const width) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 56);
+#   endif
+
+    if (br->available < width) {
+        bitreader_refill(br);
+    }
+
+    return br->buffer & low_bits_mask(width);
+}
+
+void bitreader_consume(BitReader* const br, size_t const width) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width <= br->last_bit - br->position);
+#   endif
+
+    if (width < br->available) {
+        br->buffer >>= width;
+        br->available -= (unsigned)width;
+    } else {
+        br->buffer = 0;
+        br->available = 0;
+    }
+
+    br->position += width;
+}
+
+uint64_t bitreader_read(BitReader* const br, unsigned const width) {
+#   if BIT_ARRAY_ASSERTS
+    assert(width >= 1 && width <= 64);
+    assert(width <= br->last_bit - br->position);
+#   endif
+
+    if (width <= 56) {
+        uint64_t const value = bitreader_peek(br, width);
+        bitreader_consume(br, width);
+        return value;
+    }
+
+    uint64_t const low = bitreader_peek(br, 32);
+    bitreader_consume(br, 32);
+    uint64_t const high = bitreader_peek(br, width - 32);
+    bitreader_consume(br, width - 32);
+    return low | high << 32;
+}
+
+uint64_t bitreader_read_unary(BitReader* const br) {
+    uint64_t value = 0;
+
+    for (;;) {
+        if (!br->available) {
+            bitreader_refill(br);
+
+#           if BIT_ARRAY_ASSERTS
+            assert(br->available);
+#           else
+            if (!br->available) {
+                return value;
+            }
+#           endif
+        }
+
+        if (br->buffer) {
+            unsigned const zeros = word_lowest_set(br->buffer);
+            bitreader_consume(br, zeros + 1);
+            return value + zeros;
+        }
+
+        // Only unset bits are available.
+        value += br->available;
+        br->position += br->available;
+        br->available = 0;
+    }
+}
+
+uint64_t bitreader_read_gamma(BitReader* const br) {
+    uint64_t const high = bitreader_read_unary(br);
+
+    if (!high) {
+        return 1;
+    }
+
+    return UINT64_C(1) << high | bitreader_read(br, (unsigned)high);
+}
@@ -0,0 +1,407 @@
+#include "bp_tree.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Number of parentheses summarized by a leaf of the range min-max tree.
+#define BLOCK_BITS 1024
+
+// The excess at index i is the number of opening minus closing parentheses
+// in the interval [0, i]. The excess at index -1 is zero.
+struct BpTree {
+    BitArray const* parens;
+    size_t block_count;
+    // Number of leaves of the range min-max tree, a power of two.
+    size_t leaf_count;
+    // Excess preceding every block, then the excess at the last index.
+    int64_t* excess;
+    // Minimum excess of every node of the range min-max tree, the root at
+    // index 1, the children of node k at 2k and 2k + 1, and leaf b at
+    // leaf_count + b. Leaves past the last block hold INT64_MAX.
+    int64_t* mins;
+};
+
+// Returns the minimum excess, relative to the excess preceding it, of the
+// parentheses of a byte, the first one lowest.
+static inline int byte_min_excess(uint8_t const byte) {
+    static signed char const byte_min_excess_table[256] = {
+        -8, -6, -6, -4, -6, -4, -4, -2, -6, -4, -4, -2, -4, -2, -2,  0,
+        -6, -4, -4, -2, -4, -2, -2,  0, -4, -2, -2,  0, -2,  0, -1,  1,
+        -6, -4, -4, -2, -4, -2, -2,  0, -4, -2, -2,  0, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -6, -4, -4, -2, -4, -2, -2,  0, -4, -2, -2,  0, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -5, -3, -3, -1, -3, -1, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -7, -5, -5, -3, -5, -3, -3, -1, -5, -3, -3, -1, -3, -1, -1,  1,
+        -5, -3, -3, -1, -3, -1, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -5, -3, -3, -1, -3, -1, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -6, -4, -4, -2, -4, -2, -2,  0, -4, -2, -2,  0, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -5, -3, -3, -1, -3, -1, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+        -4, -2, -2,  0, -2,  0, -1,  1, -3, -1, -1,  1, -2,  0, -1,  1,
+    };
+    return byte_min_excess_table[byte];
+}
+
+// Returns the excess of the parentheses of a byte.
+static inline int byte_excess(uint8_t const byte) {
+    return 2 * (int)word_popcount(byte) - 8;
+}
+
+// Returns the change of excess of the parenthesis at idx.
+static inline int paren_step(BpTree const* const bt, size_t const idx) {
+    return bitarray_check(bt->parens, idx) ? 1 : -1;
+}
+
+// Returns the excess at idx - 1.
+static int64_t excess_before(BpTree const* const bt, size_t const idx) {
+    size_t const block = idx / BLOCK_BITS;
+    size_t const first = block * BLOCK_BITS;
+    size_t ones = 0;
+
+    for (size_t word_idx = first / 64; word_idx != idx / 64; ++word_idx) {
+        ones += word_popcount(bitarray_load_word(bt->parens, word_idx));
+    }
+    if (idx % 64) {
+        uint64_t const word = bitarray_load_word(bt->parens, idx / 64);
+        ones += word_popcount(word & low_bits_mask(idx % 64));
+    }
+
+    return bt->excess[block] + 2 * (int64_t)ones - (int64_t)(idx - first);
+}
+
+// Returns the first index of the interval [first, last) of a block whose
+// excess is at most target, or last if there is none, where excess is the
+// excess at first - 1.
+static size_t block_forward(
+    BpTree const* const bt,
+    size_t first,
+    size_t const last,
+    int64_t excess,
+    int64_t const target
+) {
+    uint8_t const* const data = bt->parens->data;
+
+    for (; first != last; ++first) {
+        // Whole bytes whose minimum excess stays above the target are skipped.
+        while (first % 8 == 0 && last - first >= 8) {
+            uint8_t const byte = data[first / 8];
+            if (excess + byte_min_excess(byte) <= target) {
+                break;
+            }
+            excess += byte_excess(byte);
+            first += 8;
+        }
+        if (first == last) {
+            break;
+        }
+
+        excess += paren_step(bt, first);
+        if (excess <= target) {
+            return first;
+        }
+    }
+
+    return last;
+}
+
+// Returns the last index of the interval [first, last) of a block whose
+// excess is at most target, plus one, or first if there is none, where
+// excess is the excess at last - 1.
+static size_t block_backward(
+    BpTree const* const bt,
+    size_t const first,
+    size_t last,
+    int64_t excess,
+    int64_t const target
+) {
+    uint8_t const* const data = bt->parens->data;
+
+    for (; last != first; --last) {
+        // Whole bytes whose minimum excess stays above the target are skipped.
+        while (last % 8 == 0 && last - first >= 8) {
+            uint8_t const byte = data[last / 8 - 1];
+            int const change = byte_excess(byte);
+            if (excess - change + byte_min_excess(byte) <= target) {
+                break;
+            }
+            excess -= change;
+            last -= 8;
+        }
+        if (last == first) {
+            break;
+        }
+
+        if (excess <= target) {
+            return last;
+        }
+        excess -= paren_step(bt, last - 1);
+    }
+
+    return first;
+}
+
+// Returns the end of the block.
+static inline size_t block_last(BpTree const* const bt, size_t const block) {
+    size_t const length = bt->parens->length_in_bits;
+    return length - block * BLOCK_BITS > BLOCK_BITS
+        ? (block + 1) * BLOCK_BITS
+        : length;
+}
+
+// Returns the first index from first whose excess is at most target, or the
+// length of the parentheses if there is none.
+static size_t forward_search(
+    BpTree const* const bt,
+    size_t const first,
+    int64_t const target
+) {
+    size_t const length = bt->parens->length_in_bits;
+    size_t block = first / BLOCK_BITS;
+    size_t const last = block_last(bt, block);
+    size_t const found = block_forward(
+        bt,
+        first,
+        last,
+        excess_before(bt, first),
+        target
+    );
+
+    if (found != last) {
+        return found;
+    }
+
+    // Climbs to the first right sibling whose subtree reaches the target,
+    // then descends to its leftmost leaf that does.
+    size_t node = bt->leaf_count + block;
+    for (;;) {
+        if (node == 1) {
+            return length;
+        }
+        if (node % 2 == 0 && bt->mins[node + 1] <= target) {
+            ++node;
+            break;
+        }
+        node /= 2;
+    }
+
+    while (node < bt->leaf_count) {
+        node = bt->mins[2 * node] <= target ? 2 * node : 2 * node + 1;
+    }
+
+    block = node - bt->leaf_count;
+    return block_forward(
+        bt,
+        block * BLOCK_BITS,
+        block_last(bt, block),
+        bt->excess[block],
+        target
+    );
+}
+
+// Returns the last index up to last - 1 whose excess is at most target, plus
+// one. Returns zero if there is none but the excess at -1, zero, is at most
+// target, and BP_TREE_NONE if there is none at all.
+static size_t backward_search(
+    BpTree const* const bt,
+    size_t const last,
+    int64_t const target
+) {
+    size_t block = (last - 1) / BLOCK_BITS;
+    size_t const first = block * BLOCK_BITS;
+    size_t const found = block_backward(
+        bt,
+        first,
+        last,
+        excess_before(bt, last),
+        target
+    );
+
+    if (found != first) {
+        return found;
+    }
+
+    // Climbs to the first left sibling whose subtree reaches the target, then
+    // descends to its rightmost leaf that does.
+    size_t node = bt->leaf_count + block;
+    for (;;) {
+        if (node == 1) {
+            return target >= 0 ? 0 : BP_TREE_NONE;
+        }
+        if (node % 2 == 1 && bt->mins[node - 1] <= target) {
+            --node;
+            break;
+        }
+        node /= 2;
+    }
+
+    while (node < bt->leaf_count) {
+        node = bt->mins[2 * node + 1] <= target ? 2 * node + 1 : 2 * node;
+    }
+
+    block = node - bt->leaf_count;
+    return block_backward(
+        bt,
+        block * BLOCK_BITS,
+        block_last(bt, block),
+        bt->excess[block + 1],
+        target
+    );
+}
+
+BpTree* bptree_with_bitarray(BitArray const* const parens) {
+    BpTree* const bt = calloc(1, sizeof(BpTree));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bt);
+#   else
+    if (!bt) {
+        return NULL;
+    }
+#   endif
+
+    size_t const length = parens->length_in_bits;
+    size_t const block_count = 1 + (length - 1) / BLOCK_BITS;
+    size_t leaf_count = 1;
+    while (leaf_count < block_count) {
+        leaf_count *= 2;
+    }
+
+    bt->parens = parens;
+    bt->block_count = block_count;
+    bt->leaf_count = leaf_count;
+    bt->excess = malloc((block_count + 1) * sizeof(int64_t));
+    bt->mins = malloc(2 * leaf_count * sizeof(int64_t));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(bt->excess && bt->mins);
+#   else
+    if (!bt->excess || !bt->mins) {
+        bptree_delete(bt);
+        return NULL;
+    }
+#   endif
+
+    uint8_t const* const data = parens->data;
+    int64_t excess = 0;
+
+    for (size_t block = 0; block != leaf_count; ++block) {
+        int64_t min = INT64_MAX;
+
+        if (block < block_count) {
+            size_t const first = block * BLOCK_BITS;
+            size_t const last = block_last(bt, block);
+            size_t idx = first;
+
+            bt->excess[block] = excess;
+            for (; last - idx >= 8; idx += 8) {
+                uint8_t const byte = data[idx / 8];
+                int64_t const byte_min = excess + byte_min_excess(byte);
+                min = byte_min < min ? byte_min : min;
+                excess += byte_excess(byte);
+            }
+            for (; idx != last; ++idx) {
+                excess += paren_step(bt, idx);
+                min = excess < min ? excess : min;
+            }
+
+#           if BIT_ARRAY_ASSERTS
+            assert(min >= 0);
+#           endif
+        }
+
+        bt->mins[leaf_count + block] = min;
+    }
+
+#   if BIT_ARRAY_ASSERTS
+    assert(excess == 0);
+#   endif
+
+    bt->excess[block_count] = excess;
+    for (size_t node = leaf_count - 1; node; --node) {
+        int64_t const left = bt->mins[2 * node];
+        int64_t const right = bt->mins[2 * node + 1];
+        bt->mins[node] = left < right ? left : right;
+    }
+
+    return bt;
+}
+
+void bptree_delete(BpTree* const bt) {
+    if (bt) {
+        free(bt->excess);
+        free(bt->mins);
+    }
+    free(bt);
+}
+
+size_t bptree_node_count(BpTree const* const bt) {
+    return bt->parens->length_in_bits / 2;
+}
+
+size_t bptree_find_close(BpTree const* const bt, size_t const node) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bitarray_check(bt->parens, node));
+#   endif
+
+    // The first following index whose excess drops below the one at node.
+    return forward_search(bt, node + 1, excess_before(bt, node));
+}
+
+size_t bptree_find_open(BpTree const* const bt, size_t const close) {
+#   if BIT_ARRAY_ASSERTS
+    assert(!bitarray_check(bt->parens, close));
+#   endif
+
+    // Follows the last preceding index whose excess is the one at close.
+    return backward_search(bt, close, excess_before(bt, close + 1));
+}
+
+bool bptree_is_leaf(BpTree const* const bt, size_t const node) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bitarray_check(bt->parens, node));
+#   endif
+
+    return !bitarray_check(bt->parens, node + 1);
+}
+
+size_t bptree_parent(BpTree const* const bt, size_t const node) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bitarray_check(bt->parens, node));
+#   endif
+
+    // Follows the last preceding index whose excess is two less than the one
+    // at node, which precedes the opening parenthesis of the parent.
+    int64_t const target = excess_before(bt, node + 1) - 2;
+    return target < 0 ? BP_TREE_NONE : backward_search(bt, node, target);
+}
+
+size_t bptree_first_child(BpTree const* const bt, size_t const node) {
+    return bptree_is_leaf(bt, node) ? BP_TREE_NONE : node + 1;
+}
+
+size_t bptree_next_sibling(BpTree const* const bt, size_t const node) {
+    size_t const next = bptree_find_close(bt, node) + 1;
+
+    if (next == bt->parens->length_in_bits) {
+        return BP_TREE_NONE;
+    }
+
+    return bitarray_check(bt->parens, next) ? next : BP_TREE_NONE;
+}
+
+size_t bptree_subtree_size(BpTree const* const bt, size_t const node) {
+    return (bptree_find_close(bt, node) - node + 1) / 2;
+}
+
+size_t bptree_depth(BpTree const* const bt, size_t const node) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bitarray_check(bt->parens, node));
+#   endif
+
+    return (size_t)excess_before(bt, node);
+}
@@ -0,0 +1,752 @@
+#include "dynamic_bit_vector.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Capacity, in bits, of a leaf: a cache line.
+#define LEAF_BITS 512
+// Capacity, in children, of an inner node.
+#define NODE_CHILDREN 16
+// Fill of the leaves and inner nodes constructed from a bitarray.
+#define BUILD_LEAF_BITS 384
+#define BUILD_NODE_CHILDREN 12
+// Bounds the height of the tree, and the paths walked by updates.
+#define MAX_HEIGHT 64
+
+// The number of bits of a leaf is kept by its parent.
+typedef struct DynLeaf {
+    uint8_t data[LEAF_BITS / 8];
+} DynLeaf;
+
+typedef struct DynNode {
+    unsigned count;
+    // Number of bits under every child.
+    size_t sizes[NODE_CHILDREN];
+    // Number of set bits under every child.
+    size_t ones[NODE_CHILDREN];
+    // Leaves at height 1, inner nodes above.
+    void* children[NODE_CHILDREN];
+} DynNode;
+
+struct DynamicBitVector {
+    DynNode* root;
+    // Number of inner node levels.
+    unsigned height;
+    size_t length;
+    size_t ones;
+};
+
+static DynLeaf* leaf_new(void) {
+    DynLeaf* const leaf = aligned_alloc(64, sizeof(DynLeaf));
+    if (leaf) {
+        memset(leaf->data, 0x00, sizeof(leaf->data));
+    }
+    return leaf;
+}
+
+// Deallocates a subtree whose root is at the height, 0 being a leaf.
+static void subtree_delete(void* const item, unsigned const height) {
+    if (height) {
+        DynNode* const node = item;
+        for (unsigned c = 0; c != node->count; ++c) {
+            subtree_delete(node->children[c], height - 1);
+        }
+    }
+    free(item);
+}
+
+// Returns the number of set bits in the first length bits of a leaf.
+static size_t leaf_popcount(DynLeaf const* const leaf, size_t const length) {
+    size_t ones = 0;
+
+    for (size_t offset = 0; offset < length; offset += 64) {
+        unsigned const width = length - offset < 64
+            ? (unsigned)(length - offset)
+            : 64;
+        ones += word_popcount(read_bits(leaf->data, offset, width));
+    }
+
+    return ones;
+}
+
+// Inserts a bit at pos in a leaf holding length bits, fewer than LEAF_BITS.
+static void leaf_insert(
+    DynLeaf* const leaf,
+    size_t const length,
+    size_t const pos,
+    bool const bit
+) {
+    size_t const word_idx = pos / 64;
+
+    // Words past the bit move up by one bit, carrying the highest bit of the
+    // word below.
+    for (size_t j = length / 64; j > word_idx; --j) {
+        uint64_t const word = load_word(leaf->data + 8 * j);
+        uint64_t const below = load_word(leaf->data + 8 * (j - 1));
+        store_word(leaf->data + 8 * j, word << 1 | below >> 63);
+    }
+
+    uint64_t const word = load_word(leaf->data + 8 * word_idx);
+    uint64_t const low = pos % 64 ? low_bits_mask(pos % 64) : 0;
+    store_word(
+        leaf->data + 8 * word_idx,
+        (word & low) | (word & ~low) << 1 | (uint64_t)bit << (pos % 64)
+    );
+}
+
+// Erases the bit at pos in a leaf holding length bits, and returns it.
+static bool leaf_erase(
+    DynLeaf* const leaf,
+    size_t const length,
+    size_t const pos
+) {
+    size_t const word_idx = pos / 64;
+    size_t const last_word = (length - 1) / 64;
+    uint64_t const word = load_word(leaf->data + 8 * word_idx);
+    bool const bit = word >> (pos % 64) & 1u;
+    uint64_t const low = pos % 64 ? low_bits_mask(pos % 64) : 0;
+    uint64_t const above = word_idx != last_word
+        ? load_word(leaf->data + 8 * (word_idx + 1)) << 63
+        : 0;
+
+    store_word(
+        leaf->data + 8 * word_idx,
+        (word & low) | (word >> 1 & ~low) | above
+    );
+
+    // Words past the bit move down by one bit, carrying the lowest bit of
+    // the word above.
+    for (size_t j = word_idx + 1; j <= last_word; ++j) {
+        uint64_t const next = j != last_word
+            ? load_word(leaf->data + 8 * (j + 1)) << 63
+            : 0;
+        store_word(
+            leaf->data + 8 * j,
+            load_word(leaf->data + 8 * j) >> 1 | next
+        );
+    }
+
+    return bit;
+}
+
+// Appends the first count bits of src to dst, holding length bits.
+static void leaf_append(
+    DynLeaf* const dst,
+    size_t const length,
+    DynLeaf const* const src,
+    size_t const count
+) {
+    for (size_t offset = 0; offset < count; offset += 64) {
+        unsigned const width = count - offset < 64
+            ? (unsigned)(count - offset)
+            : 64;
+        write_bits(
+            dst->data,
+            length + offset,
+            width,
+            read_bits(src->data, offset, width)
+        );
+    }
+}
+
+// Opens room for a child at index c of a node that is not full.
+static void node_open(DynNode* const node, unsigned const c) {
+    unsigned const moved = node->count - c;
+    memmove(node->sizes + c + 1, node->sizes + c, moved * sizeof(size_t));
+    memmove(node->ones + c + 1, node->ones + c, moved * sizeof(size_t));
+    memmove(node->children + c + 1, node->children + c,
+        moved * sizeof(void*));
+    ++node->count;
+}
+
+// Removes the child at index c of a node, without deallocating it.
+static void node_close(DynNode* const node, unsigned const c) {
+    unsigned const moved = node->count - c - 1;
+    memmove(node->sizes + c, node->sizes + c + 1, moved * sizeof(size_t));
+    memmove(node->ones + c, node->ones + c + 1, moved * sizeof(size_t));
+    memmove(node->children + c, node->children + c + 1,
+        moved * sizeof(void*));
+    --node->count;
+}
+
+// Returns whether the child at index c of a node at the height is full.
+static bool child_full(
+    DynNode const* const node,
+    unsigned const c,
+    unsigned const height
+) {
+    return height == 1
+        ? node->sizes[c] == LEAF_BITS
+        : ((DynNode const*)node->children[c])->count == NODE_CHILDREN;
+}
+
+// Splits the full child at index c of a node at the height, which is not
+// full, in two halves. Returns false if an error occurs allocating memory.
+static bool split_child(
+    DynNode* const node,
+    unsigned const c,
+    unsigned const height
+) {
+    size_t moved_size = 0;
+    size_t moved_ones = 0;
+    void* right;
+
+    if (height == 1) {
+        DynLeaf* const left = node->children[c];
+        DynLeaf* const leaf = leaf_new();
+        if (!leaf) {
+            return false;
+        }
+
+        // The halves are whole bytes.
+        memcpy(leaf->data, left->data + LEAF_BITS / 16, LEAF_BITS / 16);
+        memset(left->data + LEAF_BITS / 16, 0x00, LEAF_BITS / 16);
+        moved_size = LEAF_BITS / 2;
+        moved_ones = leaf_popcount(leaf, moved_size);
+        right = leaf;
+    } else {
+        DynNode* const left = node->children[c];
+        DynNode* const inner = malloc(sizeof(DynNode));
+        if (!inner) {
+            return false;
+        }
+
+        unsigned const kept = NODE_CHILDREN / 2;
+        inner->count = NODE_CHILDREN - kept;
+        memcpy(inner->sizes, left->sizes + kept,
+            inner->count * sizeof(size_t));
+        memcpy(inner->ones, left->ones + kept, inner->count * sizeof(size_t));
+        memcpy(inner->children, left->children + kept,
+            inner->count * sizeof(void*));
+        left->count = kept;
+
+        for (unsigned i = 0; i != inner->count; ++i) {
+            moved_size += inner->sizes[i];
+            moved_ones += inner->ones[i];
+        }
+        right = inner;
+    }
+
+    node_open(node, c + 1);
+    node->sizes[c + 1] = moved_size;
+    node->ones[c + 1] = moved_ones;
+    node->children[c + 1] = right;
+    node->sizes[c] -= moved_size;
+    node->ones[c] -= moved_ones;
+    return true;
+}
+
+// Merges the child at index c + 1 of a node at the height into the child at
+// index c, when both fit in half a child. Returns whether they were merged.
+static bool merge_children(
+    DynNode* const node,
+    unsigned const c,
+    unsigned const height
+) {
+    if (height == 1) {
+        if (node->sizes[c] + node->sizes[c + 1] > LEAF_BITS / 2) {
+            return false;
+        }
+        leaf_append(
+            node->children[c],
+            node->sizes[c],
+            node->children[c + 1],
+            node->sizes[c + 1]
+        );
+    } else {
+        DynNode* const left = node->children[c];
+        DynNode const* const right = node->children[c + 1];
+        if (left->count + right->count > NODE_CHILDREN / 2) {
+            return false;
+        }
+        memcpy(left->sizes + left->count, right->sizes,
+            right->count * sizeof(size_t));
+        memcpy(left->ones + left->count, right->ones,
+            right->count * sizeof(size_t));
+        memcpy(left->children + left->count, right->children,
+            right->count * sizeof(void*));
+        left->count += right->count;
+    }
+
+    free(node->children[c + 1]);
+    node->sizes[c] += node->sizes[c + 1];
+    node->ones[c] += node->ones[c + 1];
+    node_close(node, c + 1);
+    return true;
+}
+
+// Constructs the tree over length bits, copied from the bitarray if any.
+static DynamicBitVector* dynbitvector_build(
+    BitArray const* const ba,
+    size_t const length
+) {
+    DynamicBitVector* const dv = malloc(sizeof(DynamicBitVector));
+    size_t count = length ? 1 + (length - 1) / BUILD_LEAF_BITS : 1;
+    void** items = malloc(count * sizeof(void*));
+    size_t* sizes = malloc(count * sizeof(size_t));
+    size_t* ones = malloc(count * sizeof(size_t));
+    size_t built = 0;
+    bool constructed = dv && items && sizes && ones;
+
+    // The leaves first.
+    for (; constructed && built != count; ++built) {
+        size_t const first = built * BUILD_LEAF_BITS;
+        size_t const size = length - first < BUILD_LEAF_BITS
+            ? length - first
+            : BUILD_LEAF_BITS;
+        DynLeaf* const leaf = leaf_new();
+
+        constructed = leaf;
+        if (leaf && ba) {
+            for (size_t offset = 0; offset < size; offset += 64) {
+                unsigned const width = size - offset < 64
+                    ? (unsigned)(size - offset)
+                    : 64;
+                write_bits(
+                    leaf->data,
+                    offset,
+                    width,
+                    read_bits(ba->data, first + offset, width)
+                );
+            }
+        }
+
+        items[built] = leaf;
+        sizes[built] = size;
+        ones[built] = leaf && ba ? leaf_popcount(leaf, size) : 0;
+    }
+
+    // Then every level of inner nodes, up to a single root.
+    unsigned height = 0;
+    while (constructed) {
+        size_t const parents = 1 + (count - 1) / BUILD_NODE_CHILDREN;
+        ++height;
+
+        for (size_t p = 0; constructed && p != parents; ++p) {
+            DynNode* const node = malloc(sizeof(DynNode));
+            size_t const first = p * BUILD_NODE_CHILDREN;
+            size_t const last = count - first < BUILD_NODE_CHILDREN
+                ? count
+                : first + BUILD_NODE_CHILDREN;
+            size_t node_size = 0;
+            size_t node_ones = 0;
+
+            if (!node) {
+                // Children not yet adopted are deallocated below.
+                for (size_t i = first; i != count; ++i) {
+                    subtree_delete(items[i], height - 1);
+                }
+                count = p;
+                constructed = false;
+                break;
+            }
+
+            node->count = (unsigned)(last - first);
+            for (size_t i = first; i != last; ++i) {
+                node->sizes[i - first] = sizes[i];
+                node->ones[i - first] = ones[i];
+                node->children[i - first] = items[i];
+                node_size += sizes[i];
+                node_ones += ones[i];
+            }
+
+            // Nodes are written over the children they adopted.
+            items[p] = node;
+            sizes[p] = node_size;
+            ones[p] = node_ones;
+        }
+
+        if (!constructed) {
+            break;
+        }
+
+        count = parents;
+        if (count == 1) {
+            break;
+        }
+    }
+
+    if (!constructed) {
+        if (items) {
+            for (size_t i = 0; i != (height ? count : built); ++i) {
+                subtree_delete(items[i], height);
+            }
+        }
+        free(dv);
+    } else {
+        dv->root = items[0];
+        dv->height = height;
+        dv->length = length;
+        dv->ones = ones[0];
+    }
+
+    free(items);
+    free(sizes);
+    free(ones);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(constructed);
+#   endif
+
+    return constructed ? dv : NULL;
+}
+
+DynamicBitVector* dynbitvector_with_length(size_t const length) {
+    return dynbitvector_build(NULL, length);
+}
+
+DynamicBitVector* dynbitvector_with_bitarray(BitArray const* const ba) {
+    return dynbitvector_build(ba, ba->length_in_bits);
+}
+
+void dynbitvector_delete(DynamicBitVector* const dv) {
+    if (dv) {
+        subtree_delete(dv->root, dv->height);
+    }
+    free(dv);
+}
+
+size_t dynbitvector_length(DynamicBitVector const* const dv) {
+    return dv->length;
+}
+
+size_t dynbitvector_ones(DynamicBitVector const* const dv) {
+    return dv->ones;
+}
+
+// Returns the leaf holding the bit at *pos, which becomes its index in the
+// leaf, after adding the set bits of the leaves preceding it to *ones.
+static DynLeaf const* find_leaf(
+    DynamicBitVector const* const dv,
+    size_t* const pos,
+    size_t* const ones
+) {
+    DynNode const* node = dv->root;
+
+    for (unsigned height = dv->height;; --height) {
+        unsigned c = 0;
+        while (*pos >= node->sizes[c]) {
+            *pos -= node->sizes[c];
+            *ones += node->ones[c];
+            ++c;
+        }
+
+        if (height == 1) {
+            return node->children[c];
+        }
+        node = node->children[c];
+    }
+}
+
+bool dynbitvector_access(
+    DynamicBitVector const* const dv,
+    size_t const bit_idx
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < dv->length);
+#   endif
+
+    size_t pos = bit_idx;
+    size_t ones = 0;
+    DynLeaf const* const leaf = find_leaf(dv, &pos, &ones);
+    return leaf->data[pos / 8] & byte_set_at(pos % 8);
+}
+
+size_t dynbitvector_rank1(
+    DynamicBitVector const* const dv,
+    size_t const bit_idx
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx <= dv->length);
+#   endif
+
+    if (bit_idx == dv->length) {
+        return dv->ones;
+    }
+
+    size_t pos = bit_idx;
+    size_t ones = 0;
+    DynLeaf const* const leaf = find_leaf(dv, &pos, &ones);
+    return ones + (pos ? leaf_popcount(leaf, pos) : 0);
+}
+
+// Returns the index of the set bit, or unset bit if zeros, preceded by rank
+// others of its kind.
+static size_t dynbitvector_select(
+    DynamicBitVector const* const dv,
+    size_t rank,
+    bool const zeros
+) {
+    DynNode const* node = dv->root;
+    size_t pos = 0;
+    unsigned c;
+
+    for (unsigned height = dv->height;; --height) {
+        for (c = 0;; ++c) {
+            size_t const kind = zeros
+                ? node->sizes[c] - node->ones[c]
+                : node->ones[c];
+            if (rank < kind) {
+                break;
+            }
+            rank -= kind;
+            pos += node->sizes[c];
+        }
+
+        if (height == 1) {
+            break;
+        }
+        node = node->children[c];
+    }
+
+    DynLeaf const* const leaf = node->children[c];
+    for (size_t offset = 0;; offset += 64) {
+        uint64_t const word = zeros
+            ? ~load_word(leaf->data + offset / 8)
+            : load_word(leaf->data + offset / 8);
+        unsigned const kind = word_popcount(word);
+        if (rank < kind) {
+            return pos + offset + word_select(word, (unsigned)rank);
+        }
+        rank -= kind;
+    }
+}
+
+size_t dynbitvector_select1(
+    DynamicBitVector const* const dv,
+    size_t const rank
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < dv->ones);
+#   endif
+
+    return dynbitvector_select(dv, rank, false);
+}
+
+size_t dynbitvector_select0(
+    DynamicBitVector const* const dv,
+    size_t const rank
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < dv->length - dv->ones);
+#   endif
+
+    return dynbitvector_select(dv, rank, true);
+}
+
+bool dynbitvector_insert(
+    DynamicBitVector* const dv,
+    size_t const bit_idx,
+    bool const bit
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx <= dv->length);
+#   endif
+
+    // A full root gets a parent first, so that every split along the path
+    // has room in the node above.
+    if (dv->root->count == NODE_CHILDREN) {
+        DynNode* const root = dv->height != MAX_HEIGHT
+            ? malloc(sizeof(DynNode))
+            : NULL;
+        bool grown = root;
+
+        if (root) {
+            root->count = 1;
+            root->sizes[0] = dv->length;
+            root->ones[0] = dv->ones;
+            root->children[0] = dv->root;
+            grown = split_child(root, 0, dv->height + 1);
+        }
+
+#       if BIT_ARRAY_ASSERTS
+        assert(grown);
+#       endif
+
+        if (!grown) {
+            free(root);
+            return false;
+        }
+        dv->root = root;
+        ++dv->height;
+    }
+
+    DynNode* path[MAX_HEIGHT];
+    unsigned slots[MAX_HEIGHT];
+    DynNode* node = dv->root;
+    size_t pos = bit_idx;
+    unsigned depth = 0;
+
+    // Splits move no bit in or out of a subtree on the path, so the counts
+    // are only updated once the bit is in its leaf.
+    for (unsigned height = dv->height;; --height) {
+        unsigned c = 0;
+        while (c + 1 < node->count && pos > node->sizes[c]) {
+            pos -= node->sizes[c];
+            ++c;
+        }
+
+        if (child_full(node, c, height)) {
+            if (!split_child(node, c, height)) {
+#               if BIT_ARRAY_ASSERTS
+                assert(false);
+#               endif
+                return false;
+            }
+            if (pos > node->sizes[c]) {
+                pos -= node->sizes[c];
+                ++c;
+            }
+        }
+
+        path[depth] = node;
+        slots[depth] = c;
+        ++depth;
+
+        if (height == 1) {
+            leaf_insert(node->children[c], node->sizes[c], pos, bit);
+            break;
+        }
+        node = node->children[c];
+    }
+
+    for (unsigned d = 0; d != depth; ++d) {
+        ++path[d]->sizes[slots[d]];
+        path[d]->ones[slots[d]] += bit;
+    }
+    ++dv->length;
+    dv->ones += bit;
+    return true;
+}
+
+bool dynbitvector_erase(DynamicBitVector* const dv, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < dv->length);
+#   endif
+
+    DynNode* path[MAX_HEIGHT];
+    unsigned slots[MAX_HEIGHT];
+    DynNode* node = dv->root;
+    size_t pos = bit_idx;
+    unsigned depth = 0;
+
+    for (unsigned height = dv->height;; --height) {
+        unsigned c = 0;
+        while (pos >= node->sizes[c]) {
+            pos -= node->sizes[c];
+            ++c;
+        }
+
+        path[depth] = node;
+        slots[depth] = c;
+        ++depth;
+
+        if (height == 1) {
+            break;
+        }
+        node = node->children[c];
+    }
+
+    unsigned const c = slots[depth - 1];
+    bool const bit = leaf_erase(node->children[c], node->sizes[c], pos);
+
+    for (unsigned d = 0; d != depth; ++d) {
+        --path[d]->sizes[slots[d]];
+        path[d]->ones[slots[d]] -= bit;
+    }
+    --dv->length;
+    dv->ones -= bit;
+
+    // Bottom up, an emptied child is dropped, or the shrunk child merged
+    // with a neighbour. A node that keeps its children stops the walk.
+    for (unsigned d = depth; d-- > 0;) {
+        DynNode* const parent = path[d];
+        unsigned const slot = slots[d];
+        unsigned const height = dv->height - d;
+
+        if (parent->count == 1) {
+            break;
+        }
+
+        if (!parent->sizes[slot]) {
+            subtree_delete(parent->children[slot], height - 1);
+            node_close(parent, slot);
+        } else if (
+            !(slot + 1 < parent->count
+                && merge_children(parent, slot, height))
+            && !(slot && merge_children(parent, slot - 1, height))
+        ) {
+            break;
+        }
+    }
+
+    // A root with a single inner child hands the root over to it.
+    while (dv->height > 1 && dv->root->count == 1) {
+        DynNode* const root = dv->root;
+        dv->root = root->children[0];
+        --dv->height;
+        free(root);
+    }
+
+    return bit;
+}
+
+// Copies the bits of a subtree whose root is at the height, 0 being a leaf,
+// to the bitarray from the index *pos, which is moved past them.
+static void subtree_copy(
+    void const* const item,
+    unsigned const height,
+    size_t const size,
+    BitArray* const ba,
+    size_t* const pos
+) {
+    if (height) {
+        DynNode const* const node = item;
+        for (unsigned c = 0; c != node->count; ++c) {
+            subtree_copy(node->children[c], height - 1, node->sizes[c], ba,
+                pos);
+        }
+        return;
+    }
+
+    DynLeaf const* const leaf = item;
+    for (size_t offset = 0; offset < size; offset += 64) {
+        unsigned const width = size - offset < 64
+            ? (unsigned)(size - offset)
+            : 64;
+        bitarray_set_bits(
+            ba,
+            *pos + offset,
+            width,
+            read_bits(leaf->data, offset, width)
+        );
+    }
+    *pos += size;
+}
+
+BitArray* dynbitvector_to_bitarray(DynamicBitVector const* const dv) {
+#   if BIT_ARRAY_ASSERTS
+    assert(dv->length);
+#   else
+    if (!dv->length) {
+        return NULL;
+    }
+#   endif
+
+    BitArray* const ba = bitarray_with_capacity(dv->length);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(ba);
+#   else
+    if (!ba) {
+        return NULL;
+    }
+#   endif
+
+    size_t pos = 0;
+    subtree_copy(dv->root, dv->height, dv->length, ba, &pos);
+    return ba;
+}
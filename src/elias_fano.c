@@ -0,0 +1,170 @@
+#include "elias_fano.h"
+#include "bit_array_internal.h"
+#include "packed_array.h"
+#include "rank_select.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct EliasFano {
+    size_t length;
+    unsigned low_width;
+    // NULL when the elements have no low bits.
+    PackedArray* lows;
+    // The element at index i sets the bit at index (element >> low_width) + i,
+    // so that the bits in between count the elements of every high part.
+    BitArray* highs;
+    RankSelect* directory;
+};
+
+EliasFano* eliasfano_with_values(
+    uint64_t const* const values,
+    size_t const length
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+    for (size_t i = 1; i < length; ++i) {
+        assert(values[i - 1] <= values[i]);
+    }
+#   endif
+
+    EliasFano* const ef = calloc(1, sizeof(EliasFano));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(ef);
+#   else
+    if (!ef) {
+        return NULL;
+    }
+#   endif
+
+    // About log2(universe / length) low bits make the high bits take at most
+    // 2 bits per element.
+    uint64_t const last = values[length - 1];
+    uint64_t const ratio = last / length;
+    unsigned const low_width = ratio ? word_highest_set(ratio) : 0;
+
+    ef->length = length;
+    ef->low_width = low_width;
+    ef->highs = bitarray_with_capacity((last >> low_width) + length + 1);
+    if (low_width) {
+        ef->lows = packedarray_with_capacity(length, low_width);
+    }
+
+#   if BIT_ARRAY_ASSERTS
+    assert(ef->highs && (ef->lows || !low_width));
+#   else
+    if (!ef->highs || (!ef->lows && low_width)) {
+        eliasfano_delete(ef);
+        return NULL;
+    }
+#   endif
+
+    for (size_t i = 0; i != length; ++i) {
+        bitarray_set(ef->highs, (values[i] >> low_width) + i);
+        if (low_width) {
+            packedarray_set(ef->lows, i, values[i]);
+        }
+    }
+
+    ef->directory = rankselect_with_bitarray(ef->highs);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(ef->directory);
+#   else
+    if (!ef->directory) {
+        eliasfano_delete(ef);
+        return NULL;
+    }
+#   endif
+
+    return ef;
+}
+
+void eliasfano_delete(EliasFano* const ef) {
+    if (ef) {
+        rankselect_delete(ef->directory);
+        bitarray_delete(ef->highs);
+        packedarray_delete(ef->lows);
+    }
+    free(ef);
+}
+
+size_t eliasfano_length(EliasFano const* const ef) {
+    return ef->length;
+}
+
+size_t eliasfano_size_in_bytes(EliasFano const* const ef) {
+    size_t size = sizeof(EliasFano)
+        + sizeof(BitArray) + storage_in_bytes(ef->highs->length_in_bits)
+        + rankselect_size_in_bytes(ef->directory);
+
+    if (ef->lows) {
+        size += sizeof(BitArray)
+            + storage_in_bytes(packedarray_bits(ef->lows)->length_in_bits);
+    }
+
+    return size;
+}
+
+// Returns the low bits of the element at idx.
+static inline uint64_t eliasfano_low(EliasFano const* const ef, size_t idx) {
+    return ef->low_width ? packedarray_get(ef->lows, idx) : 0;
+}
+
+uint64_t eliasfano_access(EliasFano const* const ef, size_t const idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(idx < ef->length);
+#   endif
+
+    uint64_t const high = rankselect_select1(ef->directory, idx) - idx;
+    return high << ef->low_width | eliasfano_low(ef, idx);
+}
+
+size_t eliasfano_next_geq(EliasFano const* const ef, uint64_t const value) {
+    size_t const highs_length = ef->highs->length_in_bits;
+    uint64_t const high = value >> ef->low_width;
+
+    // The high parts end with an unset bit each, the last one included.
+    if (high >= highs_length - ef->length) {
+        return ef->length;
+    }
+
+    // The elements of lower high parts precede the unset bit ending the
+    // previous high part.
+    size_t idx = high
+        ? rankselect_select0(ef->directory, (size_t)high - 1) - (high - 1)
+        : 0;
+    size_t bit_idx = idx + (size_t)high;
+    uint64_t const low = ef->low_width
+        ? value & low_bits_mask(ef->low_width)
+        : 0;
+
+    // Only the elements sharing the high part of the value need comparing.
+    for (; bitarray_check(ef->highs, bit_idx); ++idx, ++bit_idx) {
+        if (eliasfano_low(ef, idx) >= low) {
+            break;
+        }
+    }
+
+    return idx;
+}
+
+void eliasfano_for_each(
+    EliasFano const* const ef,
+    void (*const fn)(size_t idx, uint64_t value, void* ctx),
+    void* const ctx
+) {
+    size_t idx = 0;
+
+    for (size_t word_idx = 0; idx != ef->length; ++word_idx) {
+        uint64_t word = bitarray_load_word(ef->highs, word_idx);
+
+        for (; word; word &= word - 1) {
+            uint64_t const high = 64 * word_idx + word_lowest_set(word) - idx;
+            fn(idx, high << ef->low_width | eliasfano_low(ef, idx), ctx);
+            ++idx;
+        }
+    }
+}
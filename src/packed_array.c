@@ -0,0 +1,325 @@
+#include "packed_array.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if BIT_ARRAY_USE_SIMD && defined(__SSE2__)
+#   include <immintrin.h>
+#endif
+
+struct PackedArray {
+    size_t length;
+    unsigned width;
+    BitArray* bits;
+};
+
+PackedArray* packedarray_with_capacity(
+    size_t const length,
+    unsigned const width
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+    assert(width >= 1 && width <= 64);
+    assert(length <= SIZE_MAX / width);
+#   endif
+
+    PackedArray* const pa = malloc(sizeof(PackedArray));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(pa);
+#   else
+    if (!pa) {
+        return NULL;
+    }
+#   endif
+
+    pa->length = length;
+    pa->width = width;
+    pa->bits = bitarray_with_capacity(length * width);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(pa->bits);
+#   else
+    if (!pa->bits) {
+        free(pa);
+        return NULL;
+    }
+#   endif
+
+    return pa;
+}
+
+void packedarray_delete(PackedArray* const pa) {
+    if (pa) {
+        bitarray_delete(pa->bits);
+    }
+    free(pa);
+}
+
+size_t packedarray_length(PackedArray const* const pa) {
+    return pa->length;
+}
+
+unsigned packedarray_width(PackedArray const* const pa) {
+    return pa->width;
+}
+
+BitArray const* packedarray_bits(PackedArray const* const pa) {
+    return pa->bits;
+}
+
+uint64_t packedarray_get(PackedArray const* const pa, size_t const idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(idx < pa->length);
+#   endif
+
+    return read_bits(pa->bits->data, idx * pa->width, pa->width);
+}
+
+void packedarray_set(
+    PackedArray* const pa,
+    size_t const idx,
+    uint64_t const value
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(idx < pa->length);
+#   endif
+
+    write_bits(pa->bits->data, idx * pa->width, pa->width, value);
+}
+
+// Unpacks count elements of constant width, starting from the one at the bit
+// offset, with a single unaligned load each. Stops early at the first element
+// whose load would cross the end of the storage. Returns the number of
+// elements unpacked.
+static inline size_t unpack_loads(
+    uint8_t const* const data,
+    size_t const storage_bytes,
+    size_t offset,
+    size_t const count,
+    uint32_t* const dst,
+    unsigned const width
+) {
+    uint64_t const mask = low_bits_mask(width);
+    size_t i = 0;
+
+    // Elements are at most 32 bits wide, so with their shift they fit in the
+    // 64 bits loaded.
+    for (; i != count && offset / 8 + 8 <= storage_bytes; ++i) {
+        dst[i] = (uint32_t)((load_word(data + offset / 8) >> (offset % 8))
+            & mask);
+        offset += width;
+    }
+
+    return i;
+}
+
+#if BIT_ARRAY_USE_SIMD && defined(__AVX512VBMI__)
+// Unpacks groups of 16 elements up to 25 bits wide, starting from a byte
+// aligned bit offset, each with a single byte permutation of 64 loaded bytes.
+// Stops early before the group whose load would cross the end of the storage.
+// Returns the number of elements unpacked.
+static size_t unpack_simd(
+    uint8_t const* const data,
+    size_t const storage_bytes,
+    size_t const offset,
+    size_t const count,
+    uint32_t* const dst,
+    unsigned const width
+) {
+    // Lane j receives the 4 bytes starting from the byte of its first bit,
+    // then is shifted right by the bit of its first bit in that byte.
+    uint8_t permutation[64];
+    uint32_t shifts[16];
+    for (unsigned j = 0; j != 16; ++j) {
+        for (unsigned b = 0; b != 4; ++b) {
+            permutation[4 * j + b] = (uint8_t)(j * width / 8 + b);
+        }
+        shifts[j] = j * width % 8;
+    }
+
+    __m512i const permutation_vector = _mm512_loadu_si512(permutation);
+    __m512i const shift_vector = _mm512_loadu_si512(shifts);
+    __m512i const mask = _mm512_set1_epi32((int)low_bits_mask(width));
+    // 16 elements take exactly 2 * width bytes.
+    size_t const group_bytes = 2 * width;
+    uint8_t const* group = data + offset / 8;
+    size_t i = 0;
+
+    for (; i + 16 <= count && (size_t)(group - data) + 64 <= storage_bytes;
+        i += 16, group += group_bytes
+    ) {
+        __m512i const bytes = _mm512_permutexvar_epi8(
+            permutation_vector,
+            _mm512_loadu_si512(group)
+        );
+        __m512i const elements =
+            _mm512_and_si512(_mm512_srlv_epi32(bytes, shift_vector), mask);
+        _mm512_storeu_si512(dst + i, elements);
+    }
+
+    return i;
+}
+#elif BIT_ARRAY_USE_SIMD && defined(__AVX2__)
+// Unpacks groups of 8 elements up to 25 bits wide, starting from a byte
+// aligned bit offset, each with byte shuffles of 32 loaded bytes.
+// Stops early before the group whose load would cross the end of the storage.
+// Returns the number of elements unpacked.
+static size_t unpack_simd(
+    uint8_t const* const data,
+    size_t const storage_bytes,
+    size_t const offset,
+    size_t const count,
+    uint32_t* const dst,
+    unsigned const width
+) {
+    // Lane j receives the 4 bytes starting from the byte of its first bit,
+    // then is shifted right by the bit of its first bit in that byte. Shuffles
+    // only move bytes within 128-bit halves, so the bytes coming from each
+    // half of the loaded bytes are shuffled separately.
+    int8_t low_shuffle[32];
+    int8_t high_shuffle[32];
+    int32_t shifts[8];
+    for (unsigned j = 0; j != 8; ++j) {
+        for (unsigned b = 0; b != 4; ++b) {
+            unsigned const byte = j * width / 8 + b;
+            // Selecting a negative index zeroes the byte.
+            low_shuffle[4 * j + b] = byte < 16 ? (int8_t)byte : -1;
+            high_shuffle[4 * j + b] = byte < 16 ? -1 : (int8_t)(byte - 16);
+        }
+        shifts[j] = (int32_t)(j * width % 8);
+    }
+
+    __m256i const low_shuffle_vector =
+        _mm256_loadu_si256((__m256i const*)low_shuffle);
+    __m256i const high_shuffle_vector =
+        _mm256_loadu_si256((__m256i const*)high_shuffle);
+    __m256i const shift_vector = _mm256_loadu_si256((__m256i const*)shifts);
+    __m256i const mask = _mm256_set1_epi32((int)low_bits_mask(width));
+    // 8 elements take exactly width bytes.
+    size_t const group_bytes = width;
+    uint8_t const* group = data + offset / 8;
+    size_t i = 0;
+
+    for (; i + 8 <= count && (size_t)(group - data) + 32 <= storage_bytes;
+        i += 8, group += group_bytes
+    ) {
+        __m256i const loaded = _mm256_loadu_si256((__m256i const*)group);
+        __m256i const low = _mm256_permute2x128_si256(loaded, loaded, 0x00);
+        __m256i const high = _mm256_permute2x128_si256(loaded, loaded, 0x11);
+        __m256i const bytes = _mm256_or_si256(
+            _mm256_shuffle_epi8(low, low_shuffle_vector),
+            _mm256_shuffle_epi8(high, high_shuffle_vector)
+        );
+        __m256i const elements =
+            _mm256_and_si256(_mm256_srlv_epi32(bytes, shift_vector), mask);
+        _mm256_storeu_si256((__m256i*)(dst + i), elements);
+    }
+
+    return i;
+}
+#endif
+
+// Expands to a case of a switch on the width that unpacks with a constant
+// width.
+#define UNPACK_LOADS_CASE(w)                                                 \
+    case w:                                                                  \
+        done += unpack_loads(data, storage_bytes, offset, count - done,      \
+            dst + done, w);                                                  \
+        break;
+
+void packedarray_unpack(
+    PackedArray const* const pa,
+    size_t const first,
+    size_t const count,
+    uint32_t* const dst
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(pa->width <= 32);
+    assert(first <= pa->length && count <= pa->length - first);
+#   endif
+
+    uint8_t const* const data = pa->bits->data;
+    size_t const storage_bytes = storage_in_bytes(pa->bits->length_in_bits);
+    unsigned const width = pa->width;
+    size_t done = 0;
+
+    // Every 8 elements end on a byte boundary, from which SIMD groups start.
+    for (; done != count && (first + done) % 8; ++done) {
+        dst[done] = (uint32_t)read_bits(data, (first + done) * width, width);
+    }
+
+#   if BIT_ARRAY_USE_SIMD \
+        && (defined(__AVX512VBMI__) || defined(__AVX2__))
+    if (width <= 25) {
+        done += unpack_simd(data, storage_bytes, (first + done) * width,
+            count - done, dst + done, width);
+    }
+#   endif
+
+    size_t const offset = (first + done) * width;
+    switch (width) {
+        UNPACK_LOADS_CASE(1) UNPACK_LOADS_CASE(2) UNPACK_LOADS_CASE(3)
+        UNPACK_LOADS_CASE(4) UNPACK_LOADS_CASE(5) UNPACK_LOADS_CASE(6)
+        UNPACK_LOADS_CASE(7) UNPACK_LOADS_CASE(8) UNPACK_LOADS_CASE(9)
+        UNPACK_LOADS_CASE(10) UNPACK_LOADS_CASE(11) UNPACK_LOADS_CASE(12)
+        UNPACK_LOADS_CASE(13) UNPACK_LOADS_CASE(14) UNPACK_LOADS_CASE(15)
+        UNPACK_LOADS_CASE(16) UNPACK_LOADS_CASE(17) UNPACK_LOADS_CASE(18)
+        UNPACK_LOADS_CASE(19) UNPACK_LOADS_CASE(20) UNPACK_LOADS_CASE(21)
+        UNPACK_LOADS_CASE(22) UNPACK_LOADS_CASE(23) UNPACK_LOADS_CASE(24)
+        UNPACK_LOADS_CASE(25) UNPACK_LOADS_CASE(26) UNPACK_LOADS_CASE(27)
+        UNPACK_LOADS_CASE(28) UNPACK_LOADS_CASE(29) UNPACK_LOADS_CASE(30)
+        UNPACK_LOADS_CASE(31) UNPACK_LOADS_CASE(32)
+    }
+
+    // The last elements, whose loads would cross the end of the storage.
+    for (; done != count; ++done) {
+        dst[done] = (uint32_t)read_bits(data, (first + done) * width, width);
+    }
+}
+
+void packedarray_pack(
+    PackedArray* const pa,
+    size_t const first,
+    size_t const count,
+    uint32_t const* const src
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(pa->width <= 32);
+    assert(first <= pa->length && count <= pa->length - first);
+#   endif
+
+    if (!count) {
+        return;
+    }
+
+    unsigned const width = pa->width;
+    uint64_t const mask = low_bits_mask(width);
+    size_t const offset = first * width;
+    uint8_t* word = pa->bits->data + offset / 64 * 8;
+    unsigned filled = offset % 64;
+    // Keeps the bits of the first word that precede the first element.
+    uint64_t pending = filled ? load_word(word) & low_bits_mask(filled) : 0;
+
+    // Elements are appended to a pending word, stored once it's full.
+    for (size_t i = 0; i != count; ++i) {
+        uint64_t const element = src[i] & mask;
+        pending |= element << filled;
+        filled += width;
+
+        if (filled >= 64) {
+            store_word(word, pending);
+            word += 8;
+            filled -= 64;
+            pending = filled ? element >> (width - filled) : 0;
+        }
+    }
+
+    // Keeps the bits of the last word that follow the last element.
+    if (filled) {
+        uint64_t const kept = load_word(word) & ~low_bits_mask(filled);
+        store_word(word, kept | pending);
+    }
+}
@@ -0,0 +1,275 @@
+#include "parallel_builder.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// A sparse local turns dense once it holds more than one index per this many
+// bits of the target, where its list takes a quarter of a bitarray.
+#define SPARSE_BITS_PER_INDEX 256
+// Initial capacity, in indices, of a sparse local.
+#define SPARSE_INITIAL_CAPACITY 64
+// Size, in bytes, of the chunks of the target merged at once.
+#define MERGE_CHUNK_BYTES 32768
+
+// The bits set by a thread. Aligned to a cache line, so that threads don't
+// share the lines of their locals.
+typedef struct LocalBits {
+    alignas(64) size_t* indices;
+    size_t count;
+    size_t capacity;
+    // Replaces the indices once the local is dense. NULL while sparse.
+    BitArray* dense;
+} LocalBits;
+
+struct ParallelBuilder {
+    BitArray* target;
+    unsigned threads;
+    LocalBits* locals;
+};
+
+ParallelBuilder* parallelbuilder_with_target(
+    BitArray* const target,
+    unsigned const threads
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(threads);
+#   endif
+
+    ParallelBuilder* const pb = malloc(sizeof(ParallelBuilder));
+    LocalBits* const locals = aligned_alloc(
+        alignof(LocalBits),
+        threads * sizeof(LocalBits)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(pb && locals);
+#   else
+    if (!pb || !locals) {
+        free(pb);
+        free(locals);
+        return NULL;
+    }
+#   endif
+
+    for (unsigned thread = 0; thread != threads; ++thread) {
+        locals[thread].indices = NULL;
+        locals[thread].count = 0;
+        locals[thread].capacity = 0;
+        locals[thread].dense = NULL;
+    }
+
+    pb->target = target;
+    pb->threads = threads;
+    pb->locals = locals;
+    return pb;
+}
+
+// Deallocates the bits of a local, leaving it empty and sparse.
+static void local_reset(LocalBits* const local) {
+    free(local->indices);
+    bitarray_delete(local->dense);
+    local->indices = NULL;
+    local->count = 0;
+    local->capacity = 0;
+    local->dense = NULL;
+}
+
+void parallelbuilder_delete(ParallelBuilder* const pb) {
+    if (pb) {
+        for (unsigned thread = 0; thread != pb->threads; ++thread) {
+            local_reset(pb->locals + thread);
+        }
+        free(pb->locals);
+    }
+    free(pb);
+}
+
+unsigned parallelbuilder_threads(ParallelBuilder const* const pb) {
+    return pb->threads;
+}
+
+// Turns a sparse local dense. Returns false, leaving it sparse, if an error
+// occurs allocating memory.
+static bool local_densify(LocalBits* const local, size_t const length) {
+    BitArray* const dense = bitarray_with_capacity(length);
+    if (!dense) {
+        return false;
+    }
+
+    for (size_t i = 0; i != local->count; ++i) {
+        dense->data[local->indices[i] / 8] |=
+            byte_set_at(local->indices[i] % 8);
+    }
+
+    free(local->indices);
+    local->indices = NULL;
+    local->count = 0;
+    local->capacity = 0;
+    local->dense = dense;
+    return true;
+}
+
+bool parallelbuilder_set(
+    ParallelBuilder* const pb,
+    unsigned const thread,
+    size_t const bit_idx
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(thread < pb->threads);
+    assert(bit_idx < pb->target->length_in_bits);
+#   endif
+
+    LocalBits* const local = pb->locals + thread;
+
+    if (local->dense) {
+        local->dense->data[bit_idx / 8] |= byte_set_at(bit_idx % 8);
+        return true;
+    }
+
+    if (local->count == local->capacity) {
+        size_t const length = pb->target->length_in_bits;
+
+        if (local->count > length / SPARSE_BITS_PER_INDEX
+            && local_densify(local, length)
+        ) {
+            local->dense->data[bit_idx / 8] |= byte_set_at(bit_idx % 8);
+            return true;
+        }
+
+        size_t const capacity = local->capacity
+            ? 2 * local->capacity
+            : SPARSE_INITIAL_CAPACITY;
+        size_t* const indices = realloc(
+            local->indices,
+            capacity * sizeof(size_t)
+        );
+
+#       if BIT_ARRAY_ASSERTS
+        assert(indices);
+#       else
+        if (!indices) {
+            return false;
+        }
+#       endif
+
+        local->indices = indices;
+        local->capacity = capacity;
+    }
+
+    local->indices[local->count++] = bit_idx;
+    return true;
+}
+
+static int index_compare(void const* const lhs, void const* const rhs) {
+    size_t const a = *(size_t const*)lhs;
+    size_t const b = *(size_t const*)rhs;
+    return (a > b) - (a < b);
+}
+
+// Sorts the indices of the sparse local of the thread.
+static void sort_local(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    (void)threads;
+    LocalBits* const local = ((ParallelBuilder*)ctx)->locals + thread;
+
+    if (!local->dense && local->count > 1) {
+        qsort(local->indices, local->count, sizeof(size_t), index_compare);
+    }
+}
+
+// Returns the position of the first index of a sorted list not below value.
+static size_t lower_bound(
+    size_t const* const indices,
+    size_t const count,
+    size_t const value
+) {
+    size_t low = 0;
+    size_t high = count;
+
+    while (low != high) {
+        size_t const middle = low + (high - low) / 2;
+        if (indices[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+// ORs the locals into the words of the target of the thread, one chunk at a
+// time. The padding bytes of the last word are unset in every local.
+static void merge_chunks(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    ParallelBuilder const* const pb = ctx;
+    uint8_t* const data = pb->target->data;
+    size_t first_word;
+    size_t last_word;
+
+    bitarray_thread_words(pb->target, thread, threads, &first_word,
+        &last_word);
+    size_t const end = 8 * last_word;
+
+    for (size_t first_byte = 8 * first_word; first_byte < end;
+        first_byte += MERGE_CHUNK_BYTES
+    ) {
+        size_t const last_byte = end - first_byte < MERGE_CHUNK_BYTES
+            ? end
+            : first_byte + MERGE_CHUNK_BYTES;
+
+        for (unsigned l = 0; l != pb->threads; ++l) {
+            LocalBits const* const local = pb->locals + l;
+
+            if (local->dense) {
+                uint8_t const* const bits = local->dense->data;
+                for (size_t byte = first_byte; byte != last_byte; byte += 8) {
+                    store_word(
+                        data + byte,
+                        load_word(data + byte) | load_word(bits + byte)
+                    );
+                }
+                continue;
+            }
+
+            size_t i = lower_bound(local->indices, local->count,
+                8 * first_byte);
+            for (; i != local->count && local->indices[i] < 8 * last_byte;
+                ++i
+            ) {
+                data[local->indices[i] / 8] |=
+                    byte_set_at(local->indices[i] % 8);
+            }
+        }
+    }
+}
+
+void parallelbuilder_merge(ParallelBuilder* const pb) {
+    BitArray* const target = pb->target;
+    size_t const capacity = bitarray_capacity_in_bytes(target);
+
+    bitarray_run_parallel(pb->threads, sort_local, pb);
+
+    if (target->flags) {
+        bitarray_bytes_will_change(target, 0, capacity);
+    }
+
+    bitarray_run_placed(target, pb->threads, merge_chunks, pb);
+
+    if (target->flags) {
+        bitarray_bytes_did_change(target, 0, capacity);
+    }
+
+    for (unsigned thread = 0; thread != pb->threads; ++thread) {
+        local_reset(pb->locals + thread);
+    }
+}
@@ -0,0 +1,292 @@
+#include "rank_select.h"
+#include "bit_array_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Number of bits counted by a pair of directory words.
+#define SUPERBLOCK_BITS 512
+// Distance, in ranks, between two sampled set or unset bits.
+#define SELECT_SAMPLE 1024
+
+struct RankSelect {
+    BitArray const* bits;
+    size_t ones;
+    // Superblocks of SUPERBLOCK_BITS bits, counting the one starting at the
+    // end of the bitarray.
+    size_t superblock_count;
+    // For every superblock, the number of set bits preceding it, then the
+    // numbers of set bits from its start to its words 1 to 7, 9 bits each.
+    uint64_t* counts;
+    // The superblock of every SELECT_SAMPLE-th set bit, then of the last
+    // superblock.
+    size_t* samples1;
+    // The same for unset bits.
+    size_t* samples0;
+};
+
+// Returns the number of set bits preceding the superblock.
+static inline size_t superblock_rank1(
+    RankSelect const* const rs,
+    size_t const superblock
+) {
+    return (size_t)rs->counts[2 * superblock];
+}
+
+// Returns the number of unset bits preceding the superblock.
+static inline size_t superblock_rank0(
+    RankSelect const* const rs,
+    size_t const superblock
+) {
+    return superblock * SUPERBLOCK_BITS - superblock_rank1(rs, superblock);
+}
+
+// Returns the number of set bits from the start of the superblock to its word
+// at word_idx, in the interval [1, 8).
+static inline unsigned word_rank1(
+    uint64_t const sub_counts,
+    unsigned const word_idx
+) {
+    return (unsigned)(sub_counts >> (9 * (word_idx - 1))) & 0x1FFu;
+}
+
+// Fills the samples of count ranks, where rank_of returns the number of bits
+// of the right kind preceding a superblock.
+static void fill_samples(
+    RankSelect const* const rs,
+    size_t* const samples,
+    size_t const count,
+    size_t (*const rank_of)(RankSelect const*, size_t)
+) {
+    size_t superblock = 0;
+
+    for (size_t i = 0; i != count; ++i) {
+        size_t const rank = i * SELECT_SAMPLE;
+        while (superblock + 1 != rs->superblock_count
+            && rank_of(rs, superblock + 1) <= rank
+        ) {
+            ++superblock;
+        }
+        samples[i] = superblock;
+    }
+
+    samples[count] = rs->superblock_count - 1;
+}
+
+RankSelect* rankselect_with_counts(
+    BitArray const* const ba,
+    uint64_t* const counts,
+    size_t const ones
+) {
+    RankSelect* const rs = malloc(sizeof(RankSelect));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(rs);
+#   else
+    if (!rs) {
+        free(counts);
+        return NULL;
+    }
+#   endif
+
+    size_t const length = ba->length_in_bits;
+
+    rs->bits = ba;
+    rs->ones = ones;
+    rs->superblock_count = length / SUPERBLOCK_BITS + 1;
+    rs->counts = counts;
+
+    size_t const samples1_count = (ones + SELECT_SAMPLE - 1) / SELECT_SAMPLE;
+    size_t const samples0_count =
+        (length - ones + SELECT_SAMPLE - 1) / SELECT_SAMPLE;
+    rs->samples1 = malloc((samples1_count + samples0_count + 2)
+        * sizeof(size_t));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(rs->samples1);
+#   else
+    if (!rs->samples1) {
+        free(counts);
+        free(rs);
+        return NULL;
+    }
+#   endif
+
+    rs->samples0 = rs->samples1 + samples1_count + 1;
+    fill_samples(rs, rs->samples1, samples1_count, superblock_rank1);
+    fill_samples(rs, rs->samples0, samples0_count, superblock_rank0);
+    return rs;
+}
+
+RankSelect* rankselect_with_bitarray(BitArray const* const ba) {
+    size_t const length = ba->length_in_bits;
+    size_t const word_count = storage_in_bytes(length) / 8;
+    size_t const superblock_count = length / SUPERBLOCK_BITS + 1;
+    uint64_t* const counts = malloc(2 * superblock_count * sizeof(uint64_t));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(counts);
+#   else
+    if (!counts) {
+        return NULL;
+    }
+#   endif
+
+    size_t ones = 0;
+    for (size_t superblock = 0; superblock != superblock_count; ++superblock) {
+        uint64_t sub_counts = 0;
+        unsigned within = 0;
+
+        for (unsigned j = 0; j != 8; ++j) {
+            size_t const word_idx = 8 * superblock + j;
+            if (j) {
+                sub_counts |= (uint64_t)within << (9 * (j - 1));
+            }
+            if (word_idx < word_count) {
+                within += word_popcount(bitarray_load_word(ba, word_idx));
+            }
+        }
+
+        counts[2 * superblock] = ones;
+        counts[2 * superblock + 1] = sub_counts;
+        ones += within;
+    }
+
+    return rankselect_with_counts(ba, counts, ones);
+}
+
+void rankselect_delete(RankSelect* const rs) {
+    if (rs) {
+        free(rs->counts);
+        free(rs->samples1);
+    }
+    free(rs);
+}
+
+BitArray const* rankselect_bits(RankSelect const* const rs) {
+    return rs->bits;
+}
+
+size_t rankselect_size_in_bytes(RankSelect const* const rs) {
+    size_t const length = rs->bits->length_in_bits;
+    size_t const samples_count = (rs->ones + SELECT_SAMPLE - 1) / SELECT_SAMPLE
+        + (length - rs->ones + SELECT_SAMPLE - 1) / SELECT_SAMPLE + 2;
+    return sizeof(RankSelect)
+        + 2 * rs->superblock_count * sizeof(uint64_t)
+        + samples_count * sizeof(size_t);
+}
+
+size_t rankselect_ones(RankSelect const* const rs) {
+    return rs->ones;
+}
+
+size_t rankselect_rank1(RankSelect const* const rs, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx <= rs->bits->length_in_bits);
+#   endif
+
+    size_t const superblock = bit_idx / SUPERBLOCK_BITS;
+    unsigned const word_idx = bit_idx / 64 % 8;
+    size_t rank = superblock_rank1(rs, superblock);
+
+    if (word_idx) {
+        rank += word_rank1(rs->counts[2 * superblock + 1], word_idx);
+    }
+
+    if (bit_idx % 64) {
+        uint64_t const word = bitarray_load_word(rs->bits, bit_idx / 64);
+        rank += word_popcount(word & low_bits_mask(bit_idx % 64));
+    }
+
+    return rank;
+}
+
+size_t rankselect_rank0(RankSelect const* const rs, size_t const bit_idx) {
+    return bit_idx - rankselect_rank1(rs, bit_idx);
+}
+
+// Returns the last superblock of the interval [low, high] preceded by at most
+// rank bits of the right kind, where the first one is.
+static size_t search_superblock(
+    RankSelect const* const rs,
+    size_t low,
+    size_t high,
+    size_t const rank,
+    size_t (*const rank_of)(RankSelect const*, size_t)
+) {
+    while (low != high) {
+        size_t const middle = low + (high - low + 1) / 2;
+        if (rank_of(rs, middle) <= rank) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+size_t rankselect_select1(RankSelect const* const rs, size_t rank) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < rs->ones);
+#   endif
+
+    size_t const sample = rank / SELECT_SAMPLE;
+    size_t const superblock = search_superblock(
+        rs,
+        rs->samples1[sample],
+        rs->samples1[sample + 1],
+        rank,
+        superblock_rank1
+    );
+    uint64_t const sub_counts = rs->counts[2 * superblock + 1];
+
+    rank -= superblock_rank1(rs, superblock);
+    unsigned word_idx = 1;
+    while (word_idx != 8 && word_rank1(sub_counts, word_idx) <= rank) {
+        ++word_idx;
+    }
+    --word_idx;
+
+    if (word_idx) {
+        rank -= word_rank1(sub_counts, word_idx);
+    }
+
+    size_t const word = 8 * superblock + word_idx;
+    return 64 * word
+        + word_select(bitarray_load_word(rs->bits, word), (unsigned)rank);
+}
+
+size_t rankselect_select0(RankSelect const* const rs, size_t rank) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < rs->bits->length_in_bits - rs->ones);
+#   endif
+
+    size_t const sample = rank / SELECT_SAMPLE;
+    size_t const superblock = search_superblock(
+        rs,
+        rs->samples0[sample],
+        rs->samples0[sample + 1],
+        rank,
+        superblock_rank0
+    );
+    uint64_t const sub_counts = rs->counts[2 * superblock + 1];
+
+    rank -= superblock_rank0(rs, superblock);
+    unsigned word_idx = 1;
+    while (word_idx != 8
+        && 64 * word_idx - word_rank1(sub_counts, word_idx) <= rank
+    ) {
+        ++word_idx;
+    }
+    --word_idx;
+
+    if (word_idx) {
+        rank -= 64 * word_idx - word_rank1(sub_counts, word_idx);
+    }
+
+    size_t const word = 8 * superblock + word_idx;
+    return 64 * word
+        + word_select(~bitarray_load_word(rs->bits, word), (unsigned)rank);
+}
@@ -0,0 +1,393 @@
+#include "rrr_vector.h"
+#include "bit_array_internal.h"
+#include "bit_stream.h"
+#include "packed_array.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Number of bits of a block.
+#define BLOCK_BITS 15
+// Number of blocks between two samples.
+#define SUPERBLOCK_BLOCKS 64
+
+struct RrrVector {
+    size_t length;
+    size_t ones;
+    size_t block_count;
+    // Class of every block.
+    PackedArray* classes;
+    // Offsets of the blocks, back to back. NULL when every block is empty or
+    // full, and needs none.
+    BitArray* offsets;
+    size_t superblock_count;
+    // Number of set bits preceding every superblock.
+    size_t* rank_samples;
+    // Position of the offset of the first block of every superblock.
+    size_t* offset_samples;
+};
+
+// binomial[n][k] is the number of combinations of k elements among n.
+static uint16_t const binomial[BLOCK_BITS][BLOCK_BITS + 1] = {
+        {1, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 1, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 2, 1, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 3, 3, 1, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 4, 6, 4, 1, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 5, 10, 10, 5, 1, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 6, 15, 20, 15, 6, 1, 0,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 7, 21, 35, 35, 21, 7, 1,
+            0, 0, 0, 0, 0, 0, 0, 0},
+        {1, 8, 28, 56, 70, 56, 28, 8,
+            1, 0, 0, 0, 0, 0, 0, 0},
+        {1, 9, 36, 84, 126, 126, 84, 36,
+            9, 1, 0, 0, 0, 0, 0, 0},
+        {1, 10, 45, 120, 210, 252, 210, 120,
+            45, 10, 1, 0, 0, 0, 0, 0},
+        {1, 11, 55, 165, 330, 462, 462, 330,
+            165, 55, 11, 1, 0, 0, 0, 0},
+        {1, 12, 66, 220, 495, 792, 924, 792,
+            495, 220, 66, 12, 1, 0, 0, 0},
+        {1, 13, 78, 286, 715, 1287, 1716, 1716,
+            1287, 715, 286, 78, 13, 1, 0, 0},
+        {1, 14, 91, 364, 1001, 2002, 3003, 3432,
+            3003, 2002, 1001, 364, 91, 14, 1, 0},
+};
+
+// offset_width[c] is the number of bits of the offset of a block of class c,
+// enough for binomial(15, c) offsets.
+static unsigned char const offset_width[BLOCK_BITS + 1] = {
+    0, 4, 7, 9, 11, 12, 13, 13, 13, 13, 12, 11, 9, 7, 4, 0,
+};
+
+// Returns the offset of a block among the blocks of its class, in the
+// combinatorial number system: the sum of binomial(p, i) over the index p of
+// its i-th set bit.
+static unsigned block_encode(unsigned const bits) {
+    unsigned offset = 0;
+    unsigned count = 0;
+
+    for (unsigned p = 0; p != BLOCK_BITS; ++p) {
+        if (bits >> p & 1u) {
+            offset += binomial[p][++count];
+        }
+    }
+
+    return offset;
+}
+
+// Returns the bits of the block of a class at an offset.
+static unsigned block_decode(unsigned count, unsigned offset) {
+    unsigned bits = 0;
+
+    // The highest set bit is the greatest p whose binomial(p, count) fits.
+    for (unsigned p = BLOCK_BITS; count && p--;) {
+        if (offset >= binomial[p][count]) {
+            bits |= 1u << p;
+            offset -= binomial[p][count];
+            --count;
+        }
+    }
+
+    return bits;
+}
+
+// Returns the class of the block.
+static inline unsigned block_class(
+    RrrVector const* const rv,
+    size_t const block
+) {
+    // Classes are 4 bits wide, two per byte.
+    uint8_t const byte = packedarray_bits(rv->classes)->data[block / 2];
+    return (unsigned)(byte >> (4 * (block % 2))) & 0x0Fu;
+}
+
+// Returns the bits of a block of a class whose offset is at the position.
+static inline unsigned block_bits(
+    RrrVector const* const rv,
+    unsigned const count,
+    size_t const position
+) {
+    unsigned const width = offset_width[count];
+    unsigned const offset = width
+        ? (unsigned)read_bits(rv->offsets->data, position, width)
+        : 0;
+    return block_decode(count, offset);
+}
+
+RrrVector* rrrvector_with_bitarray(BitArray const* const ba) {
+    RrrVector* const rv = calloc(1, sizeof(RrrVector));
+
+#   if BIT_ARRAY_ASSERTS
+    assert(rv);
+#   else
+    if (!rv) {
+        return NULL;
+    }
+#   endif
+
+    size_t const length = ba->length_in_bits;
+    size_t const block_count = 1 + (length - 1) / BLOCK_BITS;
+    size_t const superblock_count = block_count / SUPERBLOCK_BLOCKS + 1;
+
+    rv->length = length;
+    rv->block_count = block_count;
+    rv->superblock_count = superblock_count;
+    rv->classes = packedarray_with_capacity(block_count, 4);
+    rv->rank_samples = malloc(2 * superblock_count * sizeof(size_t));
+
+    BitWriter* const offsets = bitwriter_with_capacity(length / 4 + 64);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(rv->classes && rv->rank_samples && offsets);
+#   else
+    if (!rv->classes || !rv->rank_samples || !offsets) {
+        bitwriter_delete(offsets);
+        rrrvector_delete(rv);
+        return NULL;
+    }
+#   endif
+
+    rv->offset_samples = rv->rank_samples + superblock_count;
+
+    bool written = true;
+    size_t ones = 0;
+
+    for (size_t block = 0; block != block_count; ++block) {
+        if (block % SUPERBLOCK_BLOCKS == 0) {
+            rv->rank_samples[block / SUPERBLOCK_BLOCKS] = ones;
+            rv->offset_samples[block / SUPERBLOCK_BLOCKS] =
+                bitwriter_length(offsets);
+        }
+
+        size_t const first = block * BLOCK_BITS;
+        unsigned const width = length - first < BLOCK_BITS
+            ? (unsigned)(length - first)
+            : BLOCK_BITS;
+        unsigned const bits = (unsigned)read_bits(ba->data, first, width);
+        unsigned const count = word_popcount(bits);
+
+        packedarray_set(rv->classes, block, count);
+        if (offset_width[count]) {
+            written = written && bitwriter_write(
+                offsets,
+                block_encode(bits),
+                offset_width[count]
+            );
+        }
+        ones += count;
+    }
+
+    // The sample past the last block, when it starts a superblock.
+    if (block_count % SUPERBLOCK_BLOCKS == 0) {
+        rv->rank_samples[superblock_count - 1] = ones;
+        rv->offset_samples[superblock_count - 1] = bitwriter_length(offsets);
+    }
+
+    rv->ones = ones;
+
+    if (bitwriter_length(offsets)) {
+        rv->offsets = bitwriter_finish(offsets);
+        written = written && rv->offsets;
+    } else {
+        bitwriter_delete(offsets);
+    }
+
+#   if BIT_ARRAY_ASSERTS
+    assert(written);
+#   else
+    if (!written) {
+        rrrvector_delete(rv);
+        return NULL;
+    }
+#   endif
+
+    return rv;
+}
+
+void rrrvector_delete(RrrVector* const rv) {
+    if (rv) {
+        packedarray_delete(rv->classes);
+        bitarray_delete(rv->offsets);
+        free(rv->rank_samples);
+    }
+    free(rv);
+}
+
+size_t rrrvector_length(RrrVector const* const rv) {
+    return rv->length;
+}
+
+size_t rrrvector_ones(RrrVector const* const rv) {
+    return rv->ones;
+}
+
+size_t rrrvector_size_in_bytes(RrrVector const* const rv) {
+    size_t size = sizeof(RrrVector)
+        + sizeof(BitArray)
+        + storage_in_bytes(packedarray_bits(rv->classes)->length_in_bits)
+        + 2 * rv->superblock_count * sizeof(size_t);
+
+    if (rv->offsets) {
+        size += sizeof(BitArray)
+            + storage_in_bytes(rv->offsets->length_in_bits);
+    }
+
+    return size;
+}
+
+// Returns the bits of the block, after adding the set bits of the blocks
+// preceding it to *ones.
+static unsigned locate_block(
+    RrrVector const* const rv,
+    size_t const block,
+    size_t* const ones
+) {
+    size_t const superblock = block / SUPERBLOCK_BLOCKS;
+    size_t position = rv->offset_samples[superblock];
+
+    *ones += rv->rank_samples[superblock];
+    for (size_t b = superblock * SUPERBLOCK_BLOCKS; b != block; ++b) {
+        unsigned const count = block_class(rv, b);
+        *ones += count;
+        position += offset_width[count];
+    }
+
+    return block < rv->block_count
+        ? block_bits(rv, block_class(rv, block), position)
+        : 0;
+}
+
+bool rrrvector_access(RrrVector const* const rv, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx < rv->length);
+#   endif
+
+    size_t ones = 0;
+    unsigned const bits = locate_block(rv, bit_idx / BLOCK_BITS, &ones);
+    return bits >> (bit_idx % BLOCK_BITS) & 1u;
+}
+
+size_t rrrvector_rank1(RrrVector const* const rv, size_t const bit_idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(bit_idx <= rv->length);
+#   endif
+
+    size_t ones = 0;
+    unsigned const bits = locate_block(rv, bit_idx / BLOCK_BITS, &ones);
+    unsigned const below = (1u << (bit_idx % BLOCK_BITS)) - 1;
+    return ones + word_popcount(bits & below);
+}
+
+size_t rrrvector_rank0(RrrVector const* const rv, size_t const bit_idx) {
+    return bit_idx - rrrvector_rank1(rv, bit_idx);
+}
+
+// Returns the number of set bits, or unset bits if zeros, preceding the
+// superblock.
+static inline size_t superblock_rank(
+    RrrVector const* const rv,
+    size_t const superblock,
+    bool const zeros
+) {
+    size_t const ones = rv->rank_samples[superblock];
+    return zeros
+        ? superblock * SUPERBLOCK_BLOCKS * BLOCK_BITS - ones
+        : ones;
+}
+
+// Returns the index of the set bit, or unset bit if zeros, preceded by rank
+// others of its kind.
+static size_t rrrvector_select(
+    RrrVector const* const rv,
+    size_t rank,
+    bool const zeros
+) {
+    // The last superblock preceded by at most rank bits of the right kind
+    // holds the bit.
+    size_t low = 0;
+    size_t high = rv->superblock_count - 1;
+    while (low != high) {
+        size_t const middle = low + (high - low + 1) / 2;
+        if (superblock_rank(rv, middle, zeros) <= rank) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    size_t position = rv->offset_samples[low];
+    rank -= superblock_rank(rv, low, zeros);
+
+    for (size_t block = low * SUPERBLOCK_BLOCKS;; ++block) {
+        unsigned const count = block_class(rv, block);
+        unsigned const kind = zeros ? BLOCK_BITS - count : count;
+
+        if (rank < kind) {
+            unsigned const bits = block_bits(rv, count, position);
+            return block * BLOCK_BITS
+                + word_select(zeros ? ~bits : bits, (unsigned)rank);
+        }
+
+        rank -= kind;
+        position += offset_width[count];
+    }
+}
+
+size_t rrrvector_select1(RrrVector const* const rv, size_t const rank) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < rv->ones);
+#   endif
+
+    return rrrvector_select(rv, rank, false);
+}
+
+size_t rrrvector_select0(RrrVector const* const rv, size_t const rank) {
+#   if BIT_ARRAY_ASSERTS
+    assert(rank < rv->length - rv->ones);
+#   endif
+
+    return rrrvector_select(rv, rank, true);
+}
+
+BitArray* rrrvector_to_bitarray(RrrVector const* const rv) {
+    BitArray* const ba = bitarray_with_capacity(rv->length);
+
+#   if BIT_ARRAY_ASSERTS
+    assert(ba);
+#   else
+    if (!ba) {
+        return NULL;
+    }
+#   endif
+
+    size_t position = 0;
+
+    for (size_t block = 0; block != rv->block_count; ++block) {
+        unsigned const count = block_class(rv, block);
+
+        if (count) {
+            size_t const first = block * BLOCK_BITS;
+            unsigned const width = rv->length - first < BLOCK_BITS
+                ? (unsigned)(rv->length - first)
+                : BLOCK_BITS;
+            bitarray_set_bits(
+                ba,
+                first,
+                width,
+                block_bits(rv, count, position)
+            );
+        }
+        position += offset_width[count];
+    }
+
+    return ba;
+}
@@ -0,0 +1,450 @@
+#include "wavelet_matrix.h"
+#include "bit_array_internal.h"
+#include "rank_select.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct WaveletLevel {
+    BitArray* bits;
+    RankSelect* directory;
+    // Number of unset bits, which is the index of the first element of the
+    // next level whose bit at this level is set.
+    size_t zeros;
+} WaveletLevel;
+
+struct WaveletMatrix {
+    size_t length;
+    unsigned width;
+    // From the highest bit of the elements to the lowest.
+    WaveletLevel levels[];
+};
+
+// State shared by the threads constructing a level. Thread t handles the
+// elements in the interval [t * chunk, (t + 1) * chunk).
+typedef struct LevelBuild {
+    WaveletMatrix* wm;
+    unsigned level;
+    // The elements in the order of the level, then of the next level.
+    uint64_t const* src;
+    uint64_t* dst;
+    size_t chunk;
+    // Number of unset bits in the chunk of every thread, then index of the
+    // first element of the next level coming from it with an unset bit.
+    size_t* zeros;
+    // Index of the first element of the next level coming from the chunk of
+    // every thread with a set bit.
+    size_t* ones;
+} LevelBuild;
+
+// Returns the bit of the value at the level.
+static inline unsigned level_bit(
+    WaveletMatrix const* const wm,
+    unsigned const level,
+    uint64_t const value
+) {
+    return (unsigned)(value >> (wm->width - 1 - level)) & 1u;
+}
+
+// Returns the interval [first, last) of the elements of the chunk of thread.
+static inline void chunk_bounds(
+    size_t const chunk,
+    size_t const length,
+    unsigned const thread,
+    size_t* const first,
+    size_t* const last
+) {
+    *first = (size_t)thread * chunk < length ? (size_t)thread * chunk : length;
+    *last = length - *first > chunk ? *first + chunk : length;
+}
+
+// Stores the bits of the level of the elements of a chunk, a whole word at a
+// time, and counts the unset ones.
+static void build_level_bits(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    (void)threads;
+    LevelBuild const* const build = ctx;
+    WaveletMatrix const* const wm = build->wm;
+    size_t first;
+    size_t last;
+    chunk_bounds(build->chunk, wm->length, thread, &first, &last);
+    uint8_t* const data = wm->levels[build->level].bits->data;
+    size_t ones = 0;
+
+    for (size_t word_first = first; word_first < last; word_first += 64) {
+        size_t const word_last =
+            last - word_first > 64 ? word_first + 64 : last;
+        uint64_t word = 0;
+
+        for (size_t i = word_first; i != word_last; ++i) {
+            word |= (uint64_t)level_bit(wm, build->level, build->src[i])
+                << (i - word_first);
+        }
+
+        store_word(data + word_first / 8, word);
+        ones += word_popcount(word);
+    }
+
+    build->zeros[thread] = last - first - ones;
+}
+
+// Moves the elements of a chunk to their place in the next level.
+static void build_level_order(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    (void)threads;
+    LevelBuild const* const build = ctx;
+    WaveletMatrix const* const wm = build->wm;
+    size_t first;
+    size_t last;
+    chunk_bounds(build->chunk, wm->length, thread, &first, &last);
+    size_t zero_idx = build->zeros[thread];
+    size_t one_idx = build->ones[thread];
+
+    for (size_t i = first; i != last; ++i) {
+        uint64_t const value = build->src[i];
+        if (level_bit(wm, build->level, value)) {
+            build->dst[one_idx++] = value;
+        } else {
+            build->dst[zero_idx++] = value;
+        }
+    }
+}
+
+// Constructs the directories of every threads-th level.
+static void build_directories(
+    void* const ctx,
+    unsigned const thread,
+    unsigned const threads
+) {
+    WaveletMatrix* const wm = ctx;
+
+    for (unsigned level = thread; level < wm->width; level += threads) {
+        wm->levels[level].directory =
+            rankselect_with_bitarray(wm->levels[level].bits);
+    }
+}
+
+WaveletMatrix* waveletmatrix_with_values(
+    uint64_t const* const values,
+    size_t const length,
+    unsigned threads
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(length);
+#   endif
+
+    uint64_t greatest = 0;
+    for (size_t i = 0; i != length; ++i) {
+        greatest |= values[i];
+    }
+
+    unsigned const width = greatest ? word_highest_set(greatest) + 1 : 1;
+    WaveletMatrix* const wm = calloc(
+        1,
+        sizeof(WaveletMatrix) + width * sizeof(WaveletLevel)
+    );
+
+#   if BIT_ARRAY_ASSERTS
+    assert(wm);
+#   else
+    if (!wm) {
+        return NULL;
+    }
+#   endif
+
+    wm->length = length;
+    wm->width = width;
+
+    if (!threads) {
+        threads = 1;
+    }
+
+    uint64_t* const buffers = malloc(2 * length * sizeof(uint64_t));
+    size_t* const counts = malloc(2 * threads * sizeof(size_t));
+    bool constructed = buffers && counts;
+
+    // Chunks of whole words let the threads store the bits of a level
+    // without sharing any word.
+    size_t const chunk = ((length + threads - 1) / threads + 63) / 64 * 64;
+    LevelBuild build = {
+        .wm = wm,
+        .src = values,
+        .dst = buffers,
+        .chunk = chunk,
+        .zeros = counts,
+        .ones = counts + threads,
+    };
+
+    for (unsigned level = 0; constructed && level != width; ++level) {
+        wm->levels[level].bits = bitarray_with_capacity(length);
+        if (!wm->levels[level].bits) {
+            constructed = false;
+            break;
+        }
+
+        build.level = level;
+        bitarray_run_parallel(threads, build_level_bits, &build);
+
+        size_t zeros = 0;
+        for (unsigned thread = 0; thread != threads; ++thread) {
+            zeros += build.zeros[thread];
+        }
+        wm->levels[level].zeros = zeros;
+
+        if (level + 1 == width) {
+            break;
+        }
+
+        size_t zero_idx = 0;
+        size_t one_idx = zeros;
+        for (unsigned thread = 0; thread != threads; ++thread) {
+            size_t first;
+            size_t last;
+            chunk_bounds(chunk, length, thread, &first, &last);
+            size_t const thread_zeros = build.zeros[thread];
+            build.zeros[thread] = zero_idx;
+            build.ones[thread] = one_idx;
+            zero_idx += thread_zeros;
+            one_idx += last - first - thread_zeros;
+        }
+
+        bitarray_run_parallel(threads, build_level_order, &build);
+
+        build.src = build.dst;
+        build.dst = build.dst == buffers ? buffers + length : buffers;
+    }
+
+    free(buffers);
+    free(counts);
+
+    if (constructed) {
+        bitarray_run_parallel(
+            threads < width ? threads : width,
+            build_directories,
+            wm
+        );
+        for (unsigned level = 0; level != width; ++level) {
+            constructed = constructed && wm->levels[level].directory;
+        }
+    }
+
+#   if BIT_ARRAY_ASSERTS
+    assert(constructed);
+#   else
+    if (!constructed) {
+        waveletmatrix_delete(wm);
+        return NULL;
+    }
+#   endif
+
+    return wm;
+}
+
+void waveletmatrix_delete(WaveletMatrix* const wm) {
+    if (wm) {
+        for (unsigned level = 0; level != wm->width; ++level) {
+            rankselect_delete(wm->levels[level].directory);
+            bitarray_delete(wm->levels[level].bits);
+        }
+    }
+    free(wm);
+}
+
+size_t waveletmatrix_length(WaveletMatrix const* const wm) {
+    return wm->length;
+}
+
+unsigned waveletmatrix_width(WaveletMatrix const* const wm) {
+    return wm->width;
+}
+
+// Returns the index, in the next level, of the element at idx of the level
+// whose bit at the level is bit.
+static inline size_t next_level_idx(
+    WaveletLevel const* const level,
+    unsigned const bit,
+    size_t const idx
+) {
+    return bit
+        ? level->zeros + rankselect_rank1(level->directory, idx)
+        : rankselect_rank0(level->directory, idx);
+}
+
+// Returns whether the value has bits above the width of the elements.
+static inline bool too_wide(WaveletMatrix const* const wm, uint64_t value) {
+    return wm->width < 64 && value >> wm->width;
+}
+
+uint64_t waveletmatrix_access(WaveletMatrix const* const wm, size_t idx) {
+#   if BIT_ARRAY_ASSERTS
+    assert(idx < wm->length);
+#   endif
+
+    uint64_t value = 0;
+
+    for (unsigned level = 0; level != wm->width; ++level) {
+        WaveletLevel const* const wl = wm->levels + level;
+        unsigned const bit = bitarray_check(wl->bits, idx);
+        value = value << 1 | bit;
+        idx = next_level_idx(wl, bit, idx);
+    }
+
+    return value;
+}
+
+size_t waveletmatrix_rank(
+    WaveletMatrix const* const wm,
+    uint64_t const value,
+    size_t idx
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(idx <= wm->length);
+#   endif
+
+    if (too_wide(wm, value)) {
+        return 0;
+    }
+
+    // The occurrences of value gather between first and idx at every level.
+    size_t first = 0;
+
+    for (unsigned level = 0; level != wm->width; ++level) {
+        WaveletLevel const* const wl = wm->levels + level;
+        unsigned const bit = level_bit(wm, level, value);
+        first = next_level_idx(wl, bit, first);
+        idx = next_level_idx(wl, bit, idx);
+    }
+
+    return idx - first;
+}
+
+size_t waveletmatrix_select(
+    WaveletMatrix const* const wm,
+    uint64_t const value,
+    size_t const rank
+) {
+    if (too_wide(wm, value)) {
+        return wm->length;
+    }
+
+    // Finds the occurrences of value after the last level.
+    size_t first = 0;
+    size_t last = wm->length;
+
+    for (unsigned level = 0; level != wm->width; ++level) {
+        WaveletLevel const* const wl = wm->levels + level;
+        unsigned const bit = level_bit(wm, level, value);
+        first = next_level_idx(wl, bit, first);
+        last = next_level_idx(wl, bit, last);
+    }
+
+    if (rank >= last - first) {
+        return wm->length;
+    }
+
+    // Then follows the occurrence back up to the first level.
+    size_t idx = first + rank;
+
+    for (unsigned level = wm->width; level--;) {
+        WaveletLevel const* const wl = wm->levels + level;
+        idx = level_bit(wm, level, value)
+            ? rankselect_select1(wl->directory, idx - wl->zeros)
+            : rankselect_select0(wl->directory, idx);
+    }
+
+    return idx;
+}
+
+uint64_t waveletmatrix_quantile(
+    WaveletMatrix const* const wm,
+    size_t first,
+    size_t last,
+    size_t rank
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(first < last && last <= wm->length);
+    assert(rank < last - first);
+#   endif
+
+    uint64_t value = 0;
+
+    for (unsigned level = 0; level != wm->width; ++level) {
+        WaveletLevel const* const wl = wm->levels + level;
+        size_t const first_zeros = rankselect_rank0(wl->directory, first);
+        size_t const last_zeros = rankselect_rank0(wl->directory, last);
+        size_t const zeros = last_zeros - first_zeros;
+
+        // The elements with an unset bit at this level are the smallest.
+        if (rank < zeros) {
+            value <<= 1;
+            first = first_zeros;
+            last = last_zeros;
+        } else {
+            value = value << 1 | 1;
+            rank -= zeros;
+            first = wl->zeros + (first - first_zeros);
+            last = wl->zeros + (last - last_zeros);
+        }
+    }
+
+    return value;
+}
+
+// Returns the number of elements in the interval [first, last) less than
+// the value.
+static size_t count_less(
+    WaveletMatrix const* const wm,
+    size_t first,
+    size_t last,
+    uint64_t const value
+) {
+    if (too_wide(wm, value)) {
+        return last - first;
+    }
+
+    size_t count = 0;
+
+    for (unsigned level = 0; level != wm->width && first != last; ++level) {
+        WaveletLevel const* const wl = wm->levels + level;
+        size_t const first_zeros = rankselect_rank0(wl->directory, first);
+        size_t const last_zeros = rankselect_rank0(wl->directory, last);
+
+        // Where the value has a set bit, the elements with an unset bit are
+        // less than it.
+        if (level_bit(wm, level, value)) {
+            count += last_zeros - first_zeros;
+            first = wl->zeros + (first - first_zeros);
+            last = wl->zeros + (last - last_zeros);
+        } else {
+            first = first_zeros;
+            last = last_zeros;
+        }
+    }
+
+    return count;
+}
+
+size_t waveletmatrix_range_freq(
+    WaveletMatrix const* const wm,
+    size_t const first,
+    size_t const last,
+    uint64_t const low,
+    uint64_t const high
+) {
+#   if BIT_ARRAY_ASSERTS
+    assert(first <= last && last <= wm->length);
+#   endif
+
+    if (low >= high) {
+        return 0;
+    }
+
+    return count_less(wm, first, last, high) - count_less(wm, first, last, low);
+}